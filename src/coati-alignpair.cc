@@ -23,12 +23,16 @@
 #include <fst/fstlib.h>
 
 #include <boost/program_options.hpp>
+#include <algorithm>
+#include <cmath>
 #include <coati/align.hpp>
+#include <coati/model_file.hpp>
+#include <sstream>
 
 namespace po = boost::program_options;
 
 int main(int argc, char* argv[]) {
-    string rate;
+    string evo_times;
     bool score = false;
     input_t in_data;
 
@@ -46,11 +50,52 @@ int main(int argc, char* argv[]) {
             "Alignment output file")(
             "score,s",
             "Calculate alignment score using m-coati or m-ecm models")(
+            "score-only",
+            "Calculate only the weight of the best alignment (m-coati, "
+            "m-ecm, no_frameshifts)")(
             "rate,r", po::value<string>(&in_data.rate),
-            "Substitution rate matrix (CSV)")(
+            "Substitution rate matrix (CSV) or compiled model file")(
             "evo-time,t",
             po::value<double>(&in_data.br_len)->default_value(0.0133, "0.0133"),
-            "Evolutionary time or branch length");
+            "Evolutionary time or branch length")(
+            "evo-times", po::value<string>(&evo_times),
+            "Comma-separated evolutionary times aligned in one pass; writes "
+            "the best alignment and the weight of each time (m-coati, m-ecm)")(
+            "estimate-time",
+            "Estimate the maximum-likelihood evolutionary time, starting from "
+            "--evo-time (m-coati, m-ecm)")(
+            "dp", po::value<string>(&in_data.dp_mode)->default_value("full"),
+            "dynamic programming mode: full (default), linear (memory), "
+            "checkpoint, banded, disk, anchored, windowed, coarse, runs")(
+            "band", po::value<int>(&in_data.band_width)->default_value(0),
+            "initial band half-width for --dp banded (0: estimate)")(
+            "seed-len",
+            po::value<int>(&in_data.seed_length)->default_value(24),
+            "k-mer length of anchors for --dp anchored (multiple of 3)")(
+            "window", po::value<int>(&in_data.window)->default_value(3000),
+            "reference nucleotides per window of --dp windowed (multiple of "
+            "3)")(
+            "x-drop", po::value<double>(&in_data.x_drop)->default_value(0),
+            "stop extending DP cells whose cost exceeds the best of their "
+            "anti-diagonal by more than this (nats, 0: off; --dp full)")(
+            "gap-open",
+            po::value<double>(&in_data.indel.insertion)
+                ->default_value(0.001, "0.001"),
+            "Probability of opening an insertion or deletion")(
+            "gap-len",
+            po::value<double>(&in_data.indel.insertion_len)
+                ->default_value(6.0, "6"),
+            "Mean length of insertions and deletions in nucleotides")(
+            "temp-dir", po::value<string>(&in_data.temp_dir),
+            "directory for scratch files of --dp disk (default: system temp)")(
+            "max-memory", po::value<size_t>(&in_data.max_memory),
+            "memory limit in MB (default: no limit)")(
+            "threads", po::value<int>(&in_data.threads)->default_value(1),
+            "number of threads for --dp full, anchored, windowed, or runs "
+            "(m-coati, m-ecm)")(
+            "batch",
+            "Align consecutive pairs of sequences (m-coati, m-ecm), several "
+            "pairs at a time; output in fasta format");
 
         po::positional_options_description pos_p;
         pos_p.add("fasta", -1);
@@ -72,11 +117,93 @@ int main(int argc, char* argv[]) {
             in_data.score = true;
         }
 
+        if(varm.count("score-only")) {
+            in_data.score_only = true;
+        }
+
+        if(varm.count("batch")) {
+            in_data.batch = true;
+        }
+
+        if(varm.count("estimate-time")) {
+            in_data.estimate_br_len = true;
+        }
+
         po::notify(varm);
 
+        if(in_data.indel.insertion <= 0 || in_data.indel.insertion >= 1) {
+            cerr << "Gap opening probability must be between 0 and 1. Exiting!"
+                 << endl;
+            return EXIT_FAILURE;
+        }
+        const vector<string> dp_modes = {
+            "full",     "linear",   "checkpoint", "banded", "disk",
+            "anchored", "windowed", "coarse",     "runs"};
+        if(std::find(dp_modes.begin(), dp_modes.end(), in_data.dp_mode) ==
+           dp_modes.end()) {
+            cerr << "Unknown dynamic programming mode '" << in_data.dp_mode
+                 << "'. Exiting!" << endl;
+            return EXIT_FAILURE;
+        }
+        if(in_data.dp_mode.compare("full") != 0 && in_data.rate.empty() &&
+           (in_data.mut_model.compare("coati") == 0 ||
+            in_data.mut_model.compare("dna") == 0 ||
+            in_data.mut_model.compare("ecm") == 0)) {
+            cerr << "Dynamic programming modes are only available for "
+                    "m-coati, m-ecm, and no_frameshifts models. Exiting!"
+                 << endl;
+            return EXIT_FAILURE;
+        }
+        if(in_data.x_drop < 0) {
+            cerr << "X-drop must not be negative. Exiting!" << endl;
+            return EXIT_FAILURE;
+        }
+        if(in_data.band_width < 0) {
+            cerr << "Band width must not be negative. Exiting!" << endl;
+            return EXIT_FAILURE;
+        }
+        if(in_data.seed_length < 3 || in_data.seed_length > 30 ||
+           in_data.seed_length % 3 != 0) {
+            cerr << "Seed length must be a multiple of 3 between 3 and 30 ("
+                 << in_data.seed_length << "). Exiting!" << endl;
+            return EXIT_FAILURE;
+        }
+        if(in_data.window < 15 || in_data.window % 3 != 0) {
+            cerr << "Window length must be a multiple of 3 of at least 15 ("
+                 << in_data.window << "). Exiting!" << endl;
+            return EXIT_FAILURE;
+        }
+        if(in_data.indel.insertion_len <= 1) {
+            cerr << "Mean gap length must be greater than 1. Exiting!" << endl;
+            return EXIT_FAILURE;
+        }
+        in_data.indel.deletion = in_data.indel.insertion;
+        in_data.indel.deletion_len = in_data.indel.insertion_len;
+
+        std::stringstream times(evo_times);
+        for(string t; std::getline(times, t, ',');) {
+            // the whole entry must be a finite number
+            size_t pos = 0;
+            in_data.br_lens.push_back(std::stod(t, &pos));
+            if(pos != t.length() || !std::isfinite(in_data.br_lens.back())) {
+                throw std::invalid_argument(t);
+            }
+            if(in_data.br_lens.back() <= 0) {
+                cerr << "Evolutionary times must be positive. Exiting!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+
     } catch(po::error& e) {
         cerr << e.what() << ". Exiting!" << endl;
         return EXIT_FAILURE;
+    } catch(std::invalid_argument& e) {
+        cerr << "Invalid evolutionary time in --evo-times. Exiting!" << endl;
+        return EXIT_FAILURE;
+    } catch(std::out_of_range& e) {
+        cerr << "Evolutionary time out of range in --evo-times. Exiting!"
+             << endl;
+        return EXIT_FAILURE;
     }
 
     // read input fasta file sequences as FSA (acceptors)
@@ -87,6 +214,14 @@ int main(int argc, char* argv[]) {
         cerr << "Error reading " << in_data.fasta_file.path << " file. Exiting!"
              << endl;
         return EXIT_FAILURE;
+    } else if(in_data.batch) {
+        if(in_data.fasta_file.seq_names.empty() ||
+           in_data.fasta_file.seq_names.size() % 2 != 0 ||
+           in_data.fasta_file.seq_names.size() != fsts.size()) {
+            cerr << "An even number of sequences (pairs) required. Exiting!"
+                 << endl;
+            return EXIT_FAILURE;
+        }
     } else if(in_data.fasta_file.seq_names.size() != 2 ||
               in_data.fasta_file.seq_names.size() != fsts.size()) {
         cerr << "Exactly two sequences required. Exiting!" << endl;
@@ -97,31 +232,62 @@ int main(int argc, char* argv[]) {
                                     // dir in PHYLIP format
         in_data.out_file =
             boost::filesystem::path(in_data.fasta_file.path).stem().string() +
-            ".phy";
+            (in_data.batch ? ".fasta" : ".phy");
+    } else if(in_data.batch &&
+              boost::filesystem::extension(in_data.out_file) != ".fasta") {
+        cerr << "Batch alignment output must be in fasta format. Exiting!"
+             << endl;
+        return EXIT_FAILURE;
     } else if(boost::filesystem::extension(in_data.out_file) != ".phy" &&
               boost::filesystem::extension(in_data.out_file) != ".fasta") {
         cout << "Format for output file is not valid. Exiting!" << endl;
         return EXIT_FAILURE;
     }
 
-    if(!rate.empty()) {
+    if(in_data.estimate_br_len) {
+        return mcoati_estimate_time(in_data);
+    } else if(!in_data.br_lens.empty()) {
+        return mcoati_evo_times(in_data);
+    } else if(!in_data.rate.empty()) {
         in_data.mut_model = "user_marg_model";
 
-        Matrix64f Q;
-        double br_len;
-        parse_matrix_csv(rate, Q, br_len);
-        // P matrix
-        Q = Q * br_len;
-        P = Q.exp();
+        if(model_file_t::is_model_file(in_data.rate)) {
+            // compiled model (coati model compile). The file is mapped, so
+            // concurrent runs read one page-cached copy and skip parsing and
+            // exponentiating. P (32 KiB) is copied out of the mapping on
+            // purpose: every aligner takes a Matrix64f and marginalizes it
+            // into its own table, so the mapping is not needed afterwards.
+            try {
+                model_file_t model(in_data.rate);
+                P = model.P();
+            } catch(const std::runtime_error& e) {
+                cerr << e.what() << ". Exiting!" << endl;
+                return EXIT_FAILURE;
+            }
+        } else {
+            Matrix64f Q;
+            double br_len;
+            if(parse_matrix_csv(in_data.rate, Q, br_len) != 0) {
+                return EXIT_FAILURE;
+            }
+            // P matrix
+            Q = Q * br_len;
+            P = Q.exp();
+        }
 
-        return mcoati(in_data, P);
+        return in_data.batch ? mcoati_batch(in_data, P) : mcoati(in_data, P);
     } else if((in_data.mut_model.compare("m-coati") == 0) ||
               in_data.mut_model.compare("no_frameshifts") == 0) {
         mg94_p(P, in_data.br_len);
-        return mcoati(in_data, P);
+        return in_data.batch ? mcoati_batch(in_data, P) : mcoati(in_data, P);
     } else if(in_data.mut_model.compare("m-ecm") == 0) {
         ecm_p(P, in_data.br_len);
-        return mcoati(in_data, P);
+        return in_data.batch ? mcoati_batch(in_data, P) : mcoati(in_data, P);
+    } else if(in_data.batch) {
+        cerr << "Batch alignment is only available for m-coati and m-ecm "
+                "models. Exiting!"
+             << endl;
+        return EXIT_FAILURE;
     } else {
         return fst_alignment(in_data, fsts);
     }
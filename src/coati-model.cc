@@ -0,0 +1,73 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#include <boost/program_options.hpp>
+#include <coati/model_file.hpp>
+
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[]) {
+    string command, rate, out_file;
+
+    try {
+        po::options_description desc("Allowed options");
+        desc.add_options()("help,h", "Display this message")(
+            "command", po::value<string>(&command)->required(),
+            "compile")("rate,r", po::value<string>(&rate)->required(),
+                       "substitution rate matrix (CSV)")(
+            "output,o", po::value<string>(&out_file)->required(),
+            "compiled model file");
+
+        po::positional_options_description pos_p;
+        pos_p.add("command", 1);
+        pos_p.add("rate", 1);
+        po::variables_map varm;
+        po::store(po::command_line_parser(argc, argv)
+                      .options(desc)
+                      .positional(pos_p)
+                      .run(),
+                  varm);
+
+        if(varm.count("help") || argc < 2) {
+            cout << "Usage: coati model compile rates.csv -o model.bin "
+                    "[options]"
+                 << endl
+                 << endl;
+            cout << desc << endl;
+            return EXIT_SUCCESS;
+        }
+
+        po::notify(varm);
+
+    } catch(po::error& e) {
+        cerr << e.what() << ". Exiting!" << endl;
+        return EXIT_FAILURE;
+    }
+
+    if(command.compare("compile") != 0) {
+        cerr << "Unknown model command '" << command << "'. Exiting!" << endl;
+        return EXIT_FAILURE;
+    }
+
+    // rates, branch length, and P matrix
+    return compile_model(rate, out_file);
+}
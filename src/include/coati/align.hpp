@@ -24,14 +24,24 @@
 #define ALIGN_HPP
 
 #include <boost/filesystem.hpp>
+#include <coati/anchors.hpp>
+#include <coati/branch_length.hpp>
 #include <coati/insertions.hpp>
+#include <coati/p_engine.hpp>
 #include <coati/profile_aln.hpp>
 #include <coati/tree.hpp>
+#include <coati/windows.hpp>
 
 int mcoati(input_t& in_data, Matrix64f& P);
+int mcoati_batch(input_t& in_data, Matrix64f& P);
+int mcoati_evo_times(input_t& in_data);
+int mcoati_estimate_time(input_t& in_data);
 int progressive_aln(input_t& in_data);
 int fst_alignment(input_t& in_data, vector<VectorFst<StdArc>>& fsts);
 int ref_indel_alignment(input_t& in_data);
-float alignment_score(vector<string> alignment_t, Matrix64f& P);
+float alignment_score(vector<string> alignment_t, Matrix64f& P,
+                      const indel_params_t& indel = indel_params_t());
+size_t dp_memory_estimate(const input_t& in_data, const string& dp_mode);
+int plan_alignment(input_t& in_data);
 
 #endif
@@ -0,0 +1,52 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#ifndef ANCHORS_HPP
+#define ANCHORS_HPP
+
+#include <coati/gotoh.hpp>
+
+/* Exact match of seq_a[a, a + length) and seq_b[b, b + length). Anchors start
+ * at a codon of the reference (a % 3 == 0) and span whole codons. */
+struct anchor_t {
+    int a, b, length;
+};
+
+vector<anchor_t> find_anchors(const string& seq_a, const string& seq_b,
+                              int k = 24);
+vector<anchor_t> chain_anchors(vector<anchor_t> anchors, int margin = 6);
+size_t anchored_bytes(const string& seq_a, const string& seq_b, int k = 24);
+int mg94_marginal_anchored(vector<string> sequences, alignment_t& aln,
+                           Matrix64f& P_m, int k = 24, int threads = 1,
+                           const indel_params_t& indel = indel_params_t());
+vector<anchor_t> identity_runs(const string& seq_a, const string& seq_b,
+                               int min_run = 60, int pad = 12);
+vector<anchor_t> split_runs(const vector<anchor_t>& runs, const string& seq_a,
+                            const score_model_t& model, int pad = 12,
+                            int max_length = 300);
+size_t runs_bytes(const string& seq_a, const string& seq_b, int min_run = 60,
+                  int pad = 12, int max_length = 300, int span = 2);
+int mg94_marginal_runs(vector<string> sequences, alignment_t& aln,
+                       Matrix64f& P_m, int threads = 1,
+                       const indel_params_t& indel = indel_params_t());
+
+#endif
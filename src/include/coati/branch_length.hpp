@@ -0,0 +1,37 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#ifndef BRANCH_LENGTH_HPP
+#define BRANCH_LENGTH_HPP
+
+#include <coati/gotoh.hpp>
+#include <coati/p_engine.hpp>
+
+void emission_cost(const vector<string>& alignment, const p_engine_t& engine,
+                   double t, double& f, double& df, double& d2f);
+double branch_length_newton(const vector<string>& alignment,
+                            const p_engine_t& engine, double t);
+int estimate_branch_length(vector<string> sequences, alignment_t& aln,
+                           const p_engine_t& engine, double& t,
+                           const indel_params_t& indel = indel_params_t());
+
+#endif
@@ -23,17 +23,258 @@
 #ifndef GOTOH_HPP
 #define GOTOH_HPP
 
+#include <coati/gotoh_kernels.hpp>
 #include <coati/mutation_coati.hpp>
+#include <coati/score_model.hpp>
+#include <coati/traceback.hpp>
+#include <coati/wavefront.hpp>
 
-int mg94_marginal(vector<string> sequences, alignment_t& aln, Matrix64f& P);
+/* Largest block (in cells) that mg94_marginal_linear solves with full
+ * matrices */
+constexpr int linear_base_cells = 65536;
+
+/* Nucleotides on each side of the codon alignment path in the first band of
+ * mg94_marginal_coarse */
+constexpr int coarse_margin = 48;
+
+/* Scores and match/mismatch backtracking info of a row (or column) of DP
+ * cells */
+struct dp_line_t {
+    Eigen::VectorXf D, P, Q;
+    Eigen::VectorXi Bd;
+    dp_line_t() = default;
+    explicit dp_line_t(int size)
+        : D{Eigen::VectorXf::Constant(size, std::numeric_limits<float>::max())},
+          P{Eigen::VectorXf::Constant(size, std::numeric_limits<float>::max())},
+          Q{Eigen::VectorXf::Constant(size, std::numeric_limits<float>::max())},
+          Bd{Eigen::VectorXi::Constant(size, -1)} {}
+};
+
+/* Rows i - 1 (prev) and i (cur) of a DP matrix, both indexed relative to
+ * column c0, as a matrix for the kernels of gotoh_kernels.hpp */
+template <class Vector>
+class row_pair_t {
+   public:
+    row_pair_t(int i, int c0, Vector& prev, Vector& cur)
+        : i_{i}, c0_{c0}, prev_{prev}, cur_{cur} {}
+
+    typename Vector::Scalar& operator()(int i, int j) {
+        return (i == i_ ? cur_ : prev_)(j - c0_);
+    }
+
+   private:
+    int i_, c0_;
+    Vector& prev_;
+    Vector& cur_;
+};
+
+/* Matrix that only stores cells on diagonals lo <= j - i <= hi. Cells outside
+ * the band read as a constant value and writes to them are discarded. */
+template <class T>
+class band_matrix_t {
+   public:
+    band_matrix_t(int rows, int cols, int lo, int hi, T value)
+        : rows_{rows},
+          cols_{cols},
+          lo_{lo},
+          width_{hi - lo + 1},
+          value_{value},
+          scratch_{value},
+          data_(static_cast<size_t>(rows) * (hi - lo + 1), value) {}
+
+    bool in_band(int i, int j) const {
+        return i >= 0 && i < rows_ && j >= 0 && j < cols_ && j - i >= lo_ &&
+               j - i < lo_ + width_;
+    }
+    T operator()(int i, int j) const {
+        return in_band(i, j) ? data_[index(i, j)] : value_;
+    }
+    T& operator()(int i, int j) {
+        if(!in_band(i, j)) {
+            scratch_ = value_;
+            return scratch_;
+        }
+        return data_[index(i, j)];
+    }
+
+   private:
+    size_t index(int i, int j) const {
+        return static_cast<size_t>(i) * width_ + (j - i - lo_);
+    }
+
+    int rows_, cols_, lo_, width_;
+    T value_, scratch_;
+    vector<T> data_;
+};
+
+/* Matrix that only stores cells lo[i] <= j <= hi[i] of each row i, for bands
+ * that follow an alignment path. Cells outside the band read as a constant
+ * value and writes to them are discarded. */
+template <class T>
+class row_band_matrix_t {
+   public:
+    row_band_matrix_t(const vector<int>& lo, const vector<int>& hi, T value)
+        : lo_{lo}, hi_{hi}, start_(lo.size() + 1, 0), value_{value},
+          scratch_{value} {
+        for(size_t i = 0; i < lo.size(); i++) {
+            start_[i + 1] = start_[i] + std::max(0, hi[i] - lo[i] + 1);
+        }
+        data_.assign(start_.back(), value);
+    }
+
+    bool in_band(int i, int j) const {
+        return i >= 0 && i < static_cast<int>(lo_.size()) && j >= lo_[i] &&
+               j <= hi_[i];
+    }
+    T operator()(int i, int j) const {
+        return in_band(i, j) ? data_[start_[i] + j - lo_[i]] : value_;
+    }
+    T& operator()(int i, int j) {
+        if(!in_band(i, j)) {
+            scratch_ = value_;
+            return scratch_;
+        }
+        return data_[start_[i] + j - lo_[i]];
+    }
+
+   private:
+    vector<int> lo_, hi_;
+    vector<size_t> start_;
+    T value_, scratch_;
+    vector<T> data_;
+};
+
+/* Matrix that keeps its first cols_kept columns whole but only the last
+ * window rows of the remaining columns, for DP fills that proceed row by row
+ * and look back at most window - 1 rows. The first access to a row resets it
+ * to a constant value, so unwritten cells read as in a full matrix. */
+template <class T>
+class rolling_matrix_t {
+   public:
+    rolling_matrix_t(int rows, int cols, int window, int cols_kept, T value)
+        : cols_{cols},
+          kept_{cols_kept},
+          window_{window},
+          value_{value},
+          slot_row_(window, -1),
+          edge_(static_cast<size_t>(rows) * cols_kept, value),
+          data_(static_cast<size_t>(window) * (cols - cols_kept), value) {}
+
+    T& operator()(int i, int j) {
+        if(j < kept_) {
+            return edge_[static_cast<size_t>(i) * kept_ + j];
+        }
+        int slot = i % window_;
+        size_t start = static_cast<size_t>(slot) * (cols_ - kept_);
+        if(slot_row_[slot] != i) {
+            std::fill(data_.begin() + start,
+                      data_.begin() + start + (cols_ - kept_), value_);
+            slot_row_[slot] = i;
+        }
+        return data_[start + j - kept_];
+    }
+
+   private:
+    int cols_, kept_, window_;
+    T value_;
+    vector<int> slot_row_;
+    vector<T> edge_, data_;
+};
+
+/* Matrix-like access to the cells (i, j) with j - i a multiple of 3 of a
+ * matrix that stores them at column j / 3, a third of the columns. These are
+ * the only cells reachable in the DP with no frameshifts (see codon_fill). */
+template <class Matrix>
+class codon_view_t {
+   public:
+    explicit codon_view_t(Matrix matrix) : matrix_{matrix} {}
+    auto operator()(int i, int j) const { return matrix_(i, j / 3); }
+
+   private:
+    Matrix matrix_;
+};
+
+/* Diagonal band lo <= j - i <= hi used by a banded alignment and whether the
+ * alignment path stayed strictly inside of it */
+struct band_t {
+    int lo{0}, hi{0};
+    bool interior{false};
+};
+
+int check_codon_lengths(const vector<string>& sequences, bool both = false);
+int mg94_marginal(vector<string> sequences, alignment_t& aln, Matrix64f& P,
+                  const indel_params_t& indel = indel_params_t());
+int mg94_marginal_score_only(vector<string> sequences, alignment_t& aln,
+                             Matrix64f& P_m,
+                             const indel_params_t& indel = indel_params_t());
+int gotoh_noframeshifts_score_only(
+    vector<string> sequences, alignment_t& aln, Matrix64f& P_m,
+    const indel_params_t& indel = indel_params_t());
+int mg94_marginal_banded(vector<string> sequences, alignment_t& aln,
+                         Matrix64f& P, band_t& band, int width = 0,
+                         size_t max_memory = 0,
+                         const indel_params_t& indel = indel_params_t());
+int gotoh_noframeshifts_banded(
+    vector<string> sequences, alignment_t& aln, Matrix64f& P, band_t& band,
+    int width = 0, size_t max_memory = 0,
+    const indel_params_t& indel = indel_params_t());
+size_t banded_bytes(int m, int lo, int hi);
+string codon_coarse_ops(const string& seq_a, const string& seq_b,
+                        const score_model_t& model);
+int mg94_marginal_coarse(vector<string> sequences, alignment_t& aln,
+                         Matrix64f& P_m,
+                         const indel_params_t& indel = indel_params_t());
+void estimate_band(const string& seq_a, const string& seq_b, int& lo,
+                   int& hi);
+band_t alignment_band(const alignment_t& aln, int margin);
+int mg94_marginal_linear(vector<string> sequences, alignment_t& aln,
+                         Matrix64f& P, int base_cells = linear_base_cells,
+                         const indel_params_t& indel = indel_params_t());
+int mg94_marginal_checkpoint(vector<string> sequences, alignment_t& aln,
+                             Matrix64f& P_m, size_t max_memory = 0,
+                             int interval = 0,
+                             const indel_params_t& indel = indel_params_t());
+int checkpoint_interval(int m, int n, size_t max_memory);
+size_t checkpoint_bytes(int m, int n, int k);
+int mg94_marginal_scratch(vector<string> sequences, alignment_t& aln,
+                          Matrix64f& P_m, const string& scratch_dir,
+                          size_t max_memory,
+                          const indel_params_t& indel = indel_params_t());
+void mg94_marginal_border(const string& seq_a, const string& seq_b,
+                          const score_model_t& model, dp_line_t& top,
+                          dp_line_t& left);
+void dp_line_copy_cell(const dp_line_t& from, int k, dp_line_t& to, int l);
+int mg94_marginal_tiled(vector<string> sequences, alignment_t& aln,
+                        Matrix64f& P_m, int threads,
+                        int tile = wavefront_tile,
+                        const indel_params_t& indel = indel_params_t());
+int mg94_marginal_batch(const vector<vector<string>>& pairs,
+                        vector<alignment_t>& alns, Matrix64f& P_m,
+                        const indel_params_t& indel = indel_params_t());
+int mg94_marginal_branches(vector<string> sequences, alignment_t& aln,
+                           const vector<Matrix64f>& P_ms,
+                           vector<float>& weights,
+                           const indel_params_t& indel = indel_params_t());
+float mg94_marginal_diagonal(const string& seq_a, const string& seq_b,
+                             const score_model_t& model, traceback_t& B);
+int mg94_marginal_xdrop(vector<string> sequences, alignment_t& aln,
+                        Matrix64f& P_m, double x_drop, size_t& cells,
+                        const indel_params_t& indel = indel_params_t());
+float mg94_marginal_xdrop_diagonal(const string& seq_a, const string& seq_b,
+                                   const score_model_t& model, traceback_t& B,
+                                   double x_drop, size_t* cells = nullptr);
+void mg94_marginal_row(int i, int c0, int c1, const marginal_emission_t& em,
+                       const score_model_t& model, dp_line_t& prev,
+                       dp_line_t& cur, Eigen::VectorXi& Bp,
+                       Eigen::VectorXi& Bq);
 int gotoh_noframeshifts(vector<string> sequences, alignment_t& aln,
-                        Matrix64f& P_m);
+                        Matrix64f& P_m,
+                        const indel_params_t& indel = indel_params_t());
 double transition(string codon, int position, char nucleotide,
                   const Eigen::Tensor<double, 3>& p);
-int backtracking(Eigen::MatrixXd Bd, Eigen::MatrixXd Bp, Eigen::MatrixXd Bq,
-                 string seqa, string seqb, alignment_t& aln);
-int backtracking_noframeshifts(Eigen::MatrixXd Bd, Eigen::MatrixXd Bp,
-                               Eigen::MatrixXd Bq, string seqa, string seqb,
-                               alignment_t& aln);
+int backtracking(const traceback_t& B, string seqa, string seqb,
+                 alignment_t& aln);
+int backtracking_noframeshifts(const traceback_t& B, string seqa,
+                               string seqb, alignment_t& aln);
 
 #endif
@@ -0,0 +1,308 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#ifndef GOTOH_KERNELS_HPP
+#define GOTOH_KERNELS_HPP
+
+#include <algorithm>
+#include <coati/score_model.hpp>
+#include <limits>
+#include <vector>
+
+/* DP kernels of the Gotoh alignment, instantiated per emission policy and gap
+ * policy. An emission policy gives the dimensions of the DP matrices, rows()
+ * (reference positions) and cols() (positions of the aligned sequence), the
+ * cost match(i, j) of aligning position j to reference position i, and the
+ * background cost insertion(j) of inserting position j (positions start at
+ * 1). Gap costs are taken from a score_model_t. Only cells on diagonals
+ * lo <= j - i <= hi are computed (lo = -rows and hi = cols fill the whole
+ * matrices). */
+
+/* Emission policy of a sequence aligned to a reference with a marginal codon
+ * model (MG94, ECM, or a user rate matrix, all tabulated by score_model_t) */
+class marginal_emission_t {
+   public:
+    marginal_emission_t(const score_model_t& model, const string& seq)
+        : rows_(model.length()),
+          table_(model.emission_row(0)),
+          nucs_(seq.length() + 1),
+          freqs_(seq.length() + 1) {
+        for(size_t j = 1; j < seq.length() + 1; j++) {
+            nucs_[j] = score_model_t::nuc(seq[j - 1]);
+            freqs_[j] = model.nuc_freq(seq[j - 1]);
+        }
+    }
+
+    int rows() const { return rows_; }
+    int cols() const { return static_cast<int>(nucs_.size()) - 1; }
+    double match(int i, int j) const { return table_[5 * i + nucs_[j]]; }
+    double insertion(int j) const { return freqs_[j]; }
+
+   private:
+    int rows_;
+    const double* table_;
+    vector<int> nucs_;
+    vector<double> freqs_;
+};
+
+/* First row and column of the DP matrices with gaps of any length */
+template <class Emission, class FMatrix, class BMatrix>
+void frameshift_fill_border(const score_model_t& model, const Emission& em,
+                            int lo, int hi, FMatrix& D, FMatrix& P, FMatrix& Q,
+                            BMatrix& Bd, BMatrix& Bp, BMatrix& Bq) {
+    int m = em.rows();
+    int n = em.cols();
+
+    // fill first values on D that are independent
+    D(0, 0) = 0.0;
+    Bd(0, 0) = 0;
+    D(0, 1) = model.insertion + em.insertion(1) + model.no_insertion_ext;
+    P(0, 1) = model.insertion + em.insertion(1) + model.no_insertion_ext;
+    Bd(0, 1) = 1;
+    Bp(0, 1) = 2;
+    D(1, 0) = model.no_insertion + model.deletion + model.no_deletion_ext;
+    Q(1, 0) = model.no_insertion + model.deletion + model.no_deletion_ext;
+    Bd(1, 0) = 2;
+    Bq(1, 0) = 2;
+
+    // fill first row of D
+    if(n + 1 >= 2) {
+        for(int j = 2; j < std::min(n, hi) + 1; j++) {
+            D(0, j) = D(0, j - 1) + model.insertion_ext + em.insertion(j);
+            P(0, j) = P(0, j - 1) + model.insertion_ext + em.insertion(j);
+            Bd(0, j) = 1;
+            Bp(0, j) = 1;
+        }
+    }
+
+    // fill first column of D
+    if(m + 1 >= 2) {
+        for(int i = 2; i < std::min(m, -lo) + 1; i++) {
+            D(i, 0) = D(i - 1, 0) + model.deletion_ext;
+            Q(i, 0) = Q(i - 1, 0) + model.deletion_ext;
+            Bd(i, 0) = 2;
+            Bq(i, 0) = 1;
+        }
+    }
+}
+
+/* Rows r0 to r1 and columns c0 to c1 (r0, c0 >= 1) of the DP matrices with
+ * gaps of any length. Cells above and to the left must be filled. */
+template <class Emission, class FMatrix, class BMatrix>
+void frameshift_fill_block(const score_model_t& model, const Emission& em,
+                           int r0, int r1, int c0, int c1, int lo, int hi,
+                           FMatrix& D, FMatrix& P, FMatrix& Q, BMatrix& Bd,
+                           BMatrix& Bp, BMatrix& Bq) {
+    double p1, p2, q1, q2, d;
+
+    for(int i = r0; i < r1 + 1; i++) {
+        for(int j = std::max(c0, i + lo); j < std::min(c1, i + hi) + 1; j++) {
+            double freq = em.insertion(j);
+            // insertion
+            p1 = P(i, j - 1) + model.insertion_ext + freq;
+            p2 = Bd(i, j - 1) == 0 ? D(i, j - 1) + model.insertion + freq +
+                                         model.no_insertion_ext
+                 : Bd(i, j - 1) == 1
+                     ? D(i, j - 1) + model.insertion_ext + freq
+                     : std::numeric_limits<double>::max();
+            P(i, j) = std::min(p1, p2);
+            // 1 is insertion extension, 2 is insertion opening
+            Bp(i, j) = p1 < p2 ? 1 : 2;
+
+            // deletion
+            q1 = Q(i - 1, j) + model.deletion_ext;
+            q2 = Bd(i - 1, j) == 0 ? D(i - 1, j) + model.no_insertion +
+                                         model.deletion + model.no_deletion_ext
+                 : Bd(i - 1, j) == 1
+                     ? D(i - 1, j) + model.no_deletion_ext + model.deletion
+                     : D(i - 1, j) + model.deletion_ext;
+            Q(i, j) = std::min(q1, q2);
+            // 1 is deletion extension, 2 is deletion opening
+            Bq(i, j) = q1 < q2 ? 1 : 2;
+
+            // match/mismatch
+            double e = em.match(i, j);
+            if(Bd(i - 1, j - 1) == 0) {
+                d = D(i - 1, j - 1) + model.no_insertion + model.no_deletion +
+                    e;
+            } else if(Bd(i - 1, j - 1) == 1) {
+                d = D(i - 1, j - 1) + model.no_deletion + e;
+            } else {
+                d = D(i - 1, j - 1) + e;
+            }
+
+            // D(i,j) = highest weight between insertion, deletion, and
+            // match/mismatch
+            //	in this case, lowest (-log(weight)) value
+            if(d < P(i, j)) {
+                if(d < Q(i, j)) {
+                    D(i, j) = d;
+                    Bd(i, j) = 0;
+                } else {
+                    D(i, j) = Q(i, j);
+                    Bd(i, j) = 2;
+                }
+            } else {
+                if(P(i, j) < Q(i, j)) {
+                    D(i, j) = P(i, j);
+                    Bd(i, j) = 1;
+                } else {
+                    D(i, j) = Q(i, j);
+                    Bd(i, j) = 2;
+                }
+            }
+        }
+    }
+}
+
+/* DP matrices with gaps of whole codons only (no frameshifts). Insertions and
+ * deletions move by three cells, so only cells with j - i a multiple of 3 are
+ * reachable from (0, 0). They are filled row by row and no other cell is read
+ * or written, so matrices may store just those cells (see codon_view_t). */
+template <class Emission, class FMatrix, class BMatrix>
+void codon_fill(const score_model_t& model, const Emission& em, int lo, int hi,
+                FMatrix& D, FMatrix& P, FMatrix& Q, BMatrix& Bd, BMatrix& Bp,
+                BMatrix& Bq) {
+    int m = em.rows();
+    int n = em.cols();
+    const double max_d = std::numeric_limits<double>::max();
+
+    // costs of opening and extending an insertion with the codon ending at j
+    vector<double> ins_open(n + 1, max_d), ins_ext(n + 1, max_d);
+    for(int j = 3; j < n + 1; j++) {
+        double codon = em.insertion(j - 2) + em.insertion(j - 1) +
+                       em.insertion(j);
+        ins_open[j] = model.insertion + model.no_insertion_ext +
+                      2 * model.insertion_ext + codon;
+        ins_ext[j] = 3 * model.insertion_ext + codon;
+    }
+    // costs of deleting a codon after a match, an insertion, or a deletion
+    double del_open = model.no_insertion + model.deletion +
+                      model.no_deletion_ext + 2 * model.deletion_ext;
+    double del_after_ins =
+        model.no_deletion_ext + model.deletion + 2 * model.deletion_ext;
+    double del_ext = 3 * model.deletion_ext;
+    // costs of a match after a match or an insertion
+    double match_open = model.no_insertion + model.no_deletion;
+
+    D(0, 0) = 0.0;
+    Bd(0, 0) = 0;
+
+    double p1, p2, q1, q2, d;
+    for(int i = 0; i < m + 1; i++) {
+        // first reachable column inside the band
+        int j0 = std::max(0, i + lo);
+        j0 += ((i - j0) % 3 + 3) % 3;
+        for(int j = (i == 0 ? 3 : j0); j < std::min(n, i + hi) + 1; j += 3) {
+            // match/mismatch
+            d = max_d;
+            if(i > 0 && j > 0) {
+                double e = em.match(i, j);
+                if(Bd(i - 1, j - 1) == 0) {
+                    d = D(i - 1, j - 1) + match_open + e;
+                } else if(Bd(i - 1, j - 1) == 1) {
+                    d = D(i - 1, j - 1) + model.no_deletion + e;
+                } else {
+                    d = D(i - 1, j - 1) + e;
+                }
+            }
+            // insertion
+            if(j >= 3) {
+                p1 = P(i, j - 3) + ins_ext[j];
+                p2 = Bd(i, j - 3) == 0 ? D(i, j - 3) + ins_open[j] : max_d;
+                P(i, j) = std::min(p1, p2);
+                // 1 is insertion extension, 2 is insertion opening
+                Bp(i, j) = p1 < p2 ? 1 : 2;
+            }
+            // deletion
+            if(i >= 3) {
+                q1 = Q(i - 3, j) + del_ext;
+                q2 = Bd(i - 3, j) == 0   ? D(i - 3, j) + del_open
+                     : Bd(i - 3, j) == 1 ? D(i - 3, j) + del_after_ins
+                                         : D(i - 3, j) + del_ext;
+                Q(i, j) = std::min(q1, q2);
+                // 1 is deletion extension, 2 is deletion opening
+                Bq(i, j) = q1 < q2 ? 1 : 2;
+            }
+            double p = j >= 3 ? static_cast<double>(P(i, j)) : max_d;
+            double q = i >= 3 ? static_cast<double>(Q(i, j)) : max_d;
+
+            // D(i,j) = highest weight between insertion, deletion, and
+            // match/mismatch
+            //	in this case, lowest (-log(weight)) value
+            // (in the first codon rows a match wins ties with an insertion)
+            if(d < p || (i < 3 && d == p)) {
+                if(d < q) {
+                    D(i, j) = d;
+                    Bd(i, j) = 0;
+                } else {
+                    D(i, j) = q;
+                    Bd(i, j) = 2;
+                }
+            } else {
+                if(p < q) {
+                    D(i, j) = p;
+                    Bd(i, j) = 1;
+                } else {
+                    D(i, j) = q;
+                    Bd(i, j) = 2;
+                }
+            }
+        }
+    }
+}
+
+/* Gap policies: gaps of any length (frameshifts), or of whole codons only.
+ * step is the length of a gap step and of the band around gap openings. */
+struct frameshift_gaps_t {
+    static constexpr int step = 1;
+
+    template <class Emission, class FMatrix, class BMatrix>
+    static void fill(const score_model_t& model, const Emission& em, int lo,
+                     int hi, FMatrix& D, FMatrix& P, FMatrix& Q, BMatrix& Bd,
+                     BMatrix& Bp, BMatrix& Bq) {
+        frameshift_fill_border(model, em, lo, hi, D, P, Q, Bd, Bp, Bq);
+        frameshift_fill_block(model, em, 1, em.rows(), 1, em.cols(), lo, hi,
+                              D, P, Q, Bd, Bp, Bq);
+    }
+};
+
+struct codon_gaps_t {
+    static constexpr int step = 3;
+
+    template <class Emission, class FMatrix, class BMatrix>
+    static void fill(const score_model_t& model, const Emission& em, int lo,
+                     int hi, FMatrix& D, FMatrix& P, FMatrix& Q, BMatrix& Bd,
+                     BMatrix& Bp, BMatrix& Bq) {
+        codon_fill(model, em, lo, hi, D, P, Q, Bd, Bp, Bq);
+    }
+};
+
+/* Fill the DP matrices of the alignment with gap policy Gaps */
+template <class Gaps, class Emission, class FMatrix, class BMatrix>
+void gotoh_fill(const score_model_t& model, const Emission& em, int lo, int hi,
+                FMatrix& D, FMatrix& P, FMatrix& Q, BMatrix& Bd, BMatrix& Bp,
+                BMatrix& Bq) {
+    Gaps::fill(model, em, lo, hi, D, P, Q, Bd, Bp, Bq);
+}
+
+#endif
@@ -0,0 +1,49 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#ifndef ISA_HPP
+#define ISA_HPP
+
+#include <string>
+
+/* Instruction sets of the vector DP kernels, from oldest to newest. sse2 is
+ * the baseline (also on other architectures), with two doubles per vector;
+ * avx2 has four and avx512 eight. Kernels of every instruction set are built
+ * into libcoati and give identical results. */
+enum class isa_t { sse2, avx2, avx512 };
+
+/* Newest instruction set supported by the CPU and the operating system */
+isa_t detect_isa();
+/* Instruction set used by the vector kernels. It is chosen on first use:
+ * environment variable COATI_ISA (sse2, avx2, or avx512) if set, otherwise
+ * detect_isa() up to avx2 (avx512 is opt-in, as the wider vectors lower the
+ * clock and were slower on the DP kernels). Exits if COATI_ISA is not a
+ * supported instruction set. */
+isa_t active_isa();
+/* Use isa from now on (for tests and benchmarks). Returns false, keeping the
+ * current one, if the CPU does not support it. */
+bool set_active_isa(isa_t isa);
+
+const char* isa_name(isa_t isa);
+bool parse_isa(const std::string& name, isa_t& isa);
+
+#endif
@@ -0,0 +1,79 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#ifndef MODEL_FILE_HPP
+#define MODEL_FILE_HPP
+
+#include <coati/mutation_coati.hpp>
+#include <cstdint>
+#include <string>
+
+/* Compiled substitution model, written by `coati model compile` and memory-
+ * mapped read-only by the alignment verbs, so that concurrent processes
+ * share one page-cached copy. The file holds a header followed by the
+ * payload, all in native byte order:
+ *
+ *   magic "COATIMDL", version (uint32), reserved (uint32),
+ *   FNV-1a checksum of the payload (uint64),
+ *   payload: branch length t, rate matrix Q, and P = exp(Qt) (both 64x64,
+ *   column-major), all as doubles. */
+class model_file_t {
+   public:
+    static constexpr uint32_t version = 1;
+
+    struct header_t {
+        char magic[8];
+        uint32_t version, reserved;
+        uint64_t checksum;
+    };
+    struct payload_t {
+        double t;
+        double Q[64 * 64], P[64 * 64];
+    };
+
+    /* Map model file path. Throws std::runtime_error if the file cannot be
+     * read or is not a valid model file. */
+    explicit model_file_t(const std::string& path);
+    ~model_file_t();
+    model_file_t(const model_file_t&) = delete;
+    model_file_t& operator=(const model_file_t&) = delete;
+
+    double t() const { return payload_->t; }
+    Eigen::Map<const Matrix64f> Q() const {
+        return Eigen::Map<const Matrix64f>(payload_->Q);
+    }
+    Eigen::Map<const Matrix64f> P() const {
+        return Eigen::Map<const Matrix64f>(payload_->P);
+    }
+
+    /* Whether path starts with the magic of a model file */
+    static bool is_model_file(const std::string& path);
+    static uint64_t checksum(const payload_t& payload);
+
+   private:
+    void* map_{nullptr};
+    const payload_t* payload_{nullptr};
+};
+
+int compile_model(const std::string& csv_file, const std::string& out_file);
+
+#endif
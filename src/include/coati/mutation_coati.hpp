@@ -38,6 +38,13 @@ typedef Eigen::Matrix<double, 4, 4> Matrix4f;
 
 void mg94_q(Matrix64f& Q);
 void mg94_p(Matrix64f& P, const double& br_len);
-void mg94_marginal_p(Eigen::Tensor<double, 3>& p, Matrix64f& P);
+void mg94_marginal_p(Eigen::Tensor<double, 3>& p, const Matrix64f& P);
+
+/* Default model tables generated at build time (mg94_tables.cc): the MG94 P
+ * matrix at branch length mg94_default_brlen (column-major) and its marginal
+ * tensor (in Eigen::Tensor order) */
+extern const double mg94_default_brlen;
+extern const double mg94_default_P[64 * 64];
+extern const double mg94_default_p[64 * 3 * 4];
 
 #endif
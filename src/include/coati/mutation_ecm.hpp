@@ -27,6 +27,7 @@
 
 void nts_ntv(uint8_t c1, uint8_t c2, int& nts, int& ntv);
 double k(uint8_t c1, uint8_t c2, int model = 0);
+void ecm_q(Matrix64f& Q);
 void ecm_p(Matrix64f& P, const double& br_len);
 void ecm(VectorFst<StdArc>& mut_fst, const double& br_len);
 
@@ -28,6 +28,7 @@
 void mg94(VectorFst<StdArc>& mut_fst, const double& br_len);
 void nuc2pos(VectorFst<StdArc>& n2p);
 void dna(VectorFst<StdArc>& mut_fst, const double& br_len);
-void indel(VectorFst<StdArc>& indel_model, string model);
+void indel(VectorFst<StdArc>& indel_model, string model,
+           const indel_params_t& params = indel_params_t());
 
 #endif
@@ -34,10 +34,15 @@ Eigen::MatrixXd create_profile(string seq);
 Eigen::MatrixXd create_profile(vector<string>& aln);
 double transition(Matrix4x3d cod, int pos, Vector4d nuc,
                   const Eigen::Tensor<double, 3>& p);
+Vector4d transition_weights(Matrix4x3d cod, int pos,
+                            const Eigen::Tensor<double, 3>& p);
 int gotoh_profile_marginal(vector<string> seqs1, vector<string> seqs2,
-                           alignment_t& aln, Matrix64f& P_m);
-int backtracking_profile(Eigen::MatrixXi Bd, Eigen::MatrixXi Bp,
-                         Eigen::MatrixXi Bq, vector<string> seqs1,
+                           alignment_t& aln, Matrix64f& P_m, int threads = 1,
+                           const indel_params_t& indel = indel_params_t());
+int gotoh_profile_marginal_score_only(
+    vector<string> seqs1, vector<string> seqs2, alignment_t& aln,
+    Matrix64f& P_m, const indel_params_t& indel = indel_params_t());
+int backtracking_profile(const traceback_t& B, vector<string> seqs1,
                          vector<string> seqs2, alignment_t& aln);
 double nuc_pi(Vector4d n, Vector5d pis);
 
@@ -0,0 +1,66 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#ifndef SCORE_MODEL_HPP
+#define SCORE_MODEL_HPP
+
+#include <array>
+#include <coati/mutation_coati.hpp>
+
+/* Costs (negative log probabilities) of the marginal codon alignment model
+ * for one reference sequence. The emission cost of every nucleotide (A, C, G,
+ * T, and N for anything else) at every reference position and the gap costs
+ * are computed once, so DP kernels only look them up. Reference positions
+ * start at 1, as rows of the DP matrices. */
+class score_model_t {
+   public:
+    /* Gap costs only, for kernels whose emissions are not tabulated */
+    explicit score_model_t(const indel_params_t& indel = indel_params_t());
+    score_model_t(const string& ref, const Eigen::Tensor<double, 3>& p,
+                  const indel_params_t& indel = indel_params_t());
+
+    /* Index of nucleotide c in emission rows (A 0, C 1, G 2, T 3, N 4) */
+    static int nuc(char c) {
+        return std::min<int>(nt4_table[static_cast<uint8_t>(c)], 4);
+    }
+
+    int length() const { return length_; }
+    /* Cost of nucleotide c aligned to reference position i */
+    double emission(int i, char c) const { return table_[5 * i + nuc(c)]; }
+    /* Costs of A, C, G, T, and N aligned to reference position i */
+    const double* emission_row(int i) const { return &table_[5 * i]; }
+    /* Cost of the background frequency of nucleotide c (inserted bases) */
+    double nuc_freq(char c) const { return nuc_freqs[nuc(c)]; }
+
+    // gap opening, extension, and their complements
+    double insertion, deletion, insertion_ext, deletion_ext;
+    double no_insertion, no_deletion, no_insertion_ext, no_deletion_ext;
+    // background nucleotide frequencies (A, C, G, T, N)
+    std::array<double, 5> nuc_freqs{-log(0.308), -log(0.185), -log(0.199),
+                                    -log(0.308), -log(0.25)};
+
+   private:
+    int length_{0};
+    vector<double> table_;
+};
+
+#endif
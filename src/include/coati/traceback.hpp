@@ -0,0 +1,153 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#ifndef TRACEBACK_HPP
+#define TRACEBACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+/* Backtracking info of a DP alignment packed in one byte per cell. Bits 0-1
+ * hold the match/mismatch info (Bd), bits 2-3 the insertion info (Bp), and
+ * bits 4-5 the deletion info (Bq). Each field stores 0, 1, or 2, and 3 marks
+ * an unset cell (read as -1). Rows are stored contiguously (row-major) and
+ * padded to a multiple of the cache line size.
+ *
+ * Rows are either kept in memory or spilled to a scratch file, of which only
+ * a window of consecutive rows is memory-mapped at a time. The window slides
+ * forward while the DP is filled and backward while tracing back. */
+class traceback_t {
+   public:
+    static constexpr size_t cache_line = 64;
+    static constexpr int shift_d = 0, shift_p = 2, shift_q = 4;
+
+    /* Reference to one 2-bit field of a cell */
+    class ref_t {
+       public:
+        ref_t(uint8_t* cell, int shift) : cell_{cell}, shift_{shift} {}
+        operator int() const {
+            int v = (*cell_ >> shift_) & 3;
+            return v == 3 ? -1 : v;
+        }
+        ref_t& operator=(int v) {
+            *cell_ = static_cast<uint8_t>((*cell_ & ~(3 << shift_)) |
+                                          ((v & 3) << shift_));
+            return *this;
+        }
+        ref_t& operator=(const ref_t& other) {
+            return *this = static_cast<int>(other);
+        }
+
+       private:
+        uint8_t* cell_;
+        int shift_;
+    };
+
+    /* Matrix-like access to one field (Bd, Bp, or Bq) of all cells */
+    class view_t {
+       public:
+        view_t(traceback_t* tb, int shift) : tb_{tb}, shift_{shift} {}
+        ref_t operator()(int i, int j) const {
+            return ref_t(tb_->cell(i, j), shift_);
+        }
+
+       private:
+        traceback_t* tb_;
+        int shift_;
+    };
+
+    traceback_t(int rows, int cols);
+    traceback_t(int rows, int cols, const std::string& scratch_dir,
+                size_t window_bytes);
+    traceback_t(const traceback_t&) = delete;
+    traceback_t& operator=(const traceback_t&) = delete;
+    ~traceback_t();
+
+    /* Pack match/mismatch, insertion, and deletion info of a cell */
+    static uint8_t pack(int d, int p, int q) {
+        return static_cast<uint8_t>((d & 3) << shift_d | (p & 3) << shift_p |
+                                    (q & 3) << shift_q);
+    }
+    /* Bytes of a row, including padding */
+    static size_t stride(int cols) {
+        return (static_cast<size_t>(cols) + cache_line - 1) / cache_line *
+               cache_line;
+    }
+
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    /* Bytes used by the backtracking info */
+    size_t bytes() const { return static_cast<size_t>(rows_) * stride_; }
+
+    /* Bytes of the rows mapped in memory */
+    size_t resident_bytes() const {
+        return static_cast<size_t>(window_rows_) * stride_;
+    }
+    bool on_disk() const { return fd_ != -1; }
+
+    uint8_t* cell(int i, int j) {
+        if(i < row0_ || i >= row1_) map_rows(i);
+        return base_ + (i - row0_) * stride_ + j;
+    }
+    const uint8_t* cell(int i, int j) const {
+        if(i < row0_ || i >= row1_) map_rows(i);
+        return base_ + (i - row0_) * stride_ + j;
+    }
+    uint8_t* row(int i) { return cell(i, 0); }
+
+    int field(int i, int j, int shift) const {
+        int v = (*cell(i, j) >> shift) & 3;
+        return v == 3 ? -1 : v;
+    }
+    int bd(int i, int j) const { return field(i, j, shift_d); }
+    int bp(int i, int j) const { return field(i, j, shift_p); }
+    int bq(int i, int j) const { return field(i, j, shift_q); }
+
+    view_t d() { return view_t(this, shift_d); }
+    view_t p() { return view_t(this, shift_p); }
+    view_t q() { return view_t(this, shift_q); }
+
+   private:
+    struct free_deleter {
+        void operator()(uint8_t* ptr) const { std::free(ptr); }
+    };
+
+    void map_rows(int i) const;
+
+    int rows_, cols_;
+    size_t stride_;
+    std::unique_ptr<uint8_t[], free_deleter> data_;
+
+    // scratch file and window of mapped rows [row0_, row1_)
+    int fd_{-1};
+    int window_rows_;
+    mutable uint8_t* map_{nullptr};
+    mutable size_t map_len_{0};
+    mutable uint8_t* base_{nullptr};
+    mutable int row0_{0}, row1_{0};
+    mutable int filled_{0};  // rows below filled_ have been initialized
+};
+
+#endif
@@ -63,10 +63,29 @@ struct fasta_t {
         : path{f}, seq_names{n}, seq_data{d} {}
 };
 
+/* Indel model: probabilities of opening an insertion or a deletion and mean
+ * lengths (in nucleotides) of insertions and deletions */
+struct indel_params_t {
+    double insertion{0.001}, deletion{0.001};
+    double insertion_len{6.0}, deletion_len{6.0};
+};
+
 struct input_t {
-    string mut_model, weight_file, out_file, rate, tree, ref;
+    string mut_model, weight_file, out_file, rate, tree, ref, dp_mode,
+        temp_dir;
     bool score;
+    bool score_only{false};
+    bool batch{false};  // align consecutive pairs of sequences
+    bool estimate_br_len{false};  // maximum-likelihood evolutionary time
     double br_len;
+    vector<double> br_lens;  // evolutionary times aligned in one sweep
+    int band_width{0};
+    int seed_length{24};  // k-mer length of --dp anchored
+    int window{3000};     // reference nucleotides per window of --dp windowed
+    double x_drop{0.0};   // nats, 0: no X-drop
+    int threads{1};
+    size_t max_memory{0};  // MB, 0: no limit
+    indel_params_t indel;
     fasta_t fasta_file;
 };
 
@@ -93,6 +112,7 @@ int write_phylip(VectorFst<StdArc>& aln, fasta_t& fasta_file);
 bool acceptor(std::string content, VectorFst<StdArc>& accept);
 int cod_distance(uint8_t cod1, uint8_t cod2);
 int cod_int(string codon);
+vector<int> compatible_codons(const string& codon);
 int parse_matrix_csv(string file, Matrix64f& P, double& br_len);
 
 #endif
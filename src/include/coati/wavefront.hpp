@@ -0,0 +1,52 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#ifndef WAVEFRONT_HPP
+#define WAVEFRONT_HPP
+
+#include <functional>
+
+/* Tile edge (in cells) of tiled DP fills: a tile of backtracking info and the
+ * DP rows used to fill it stay in the L2 cache. */
+constexpr int wavefront_tile = 256;
+
+/* Run fill(r, c) for every tile of a tile_rows x tile_cols grid using up to
+ * threads threads. Tile (r, c) is started once tiles (r - 1, c) and (r, c - 1)
+ * are done, so tiles run along anti-diagonals (wavefronts) of the grid. With
+ * one thread tiles run in row-major order. An exception thrown by fill stops
+ * the scheduling of new tiles and is rethrown once all threads have joined. */
+void wavefront(int tile_rows, int tile_cols, int threads,
+               const std::function<void(int, int)>& fill);
+
+/* Run run(t) for every task t = 0 .. tasks - 1, which are independent of each
+ * other, using a pool of up to threads threads that take tasks in order. An
+ * exception thrown by run stops the pool and is rethrown once all threads
+ * have joined. */
+void parallel_tasks(int tasks, int threads,
+                    const std::function<void(int)>& run);
+
+/* Number of tiles of tile_size cells needed to cover cells 1 to size */
+inline int wavefront_tiles(int size, int tile_size = wavefront_tile) {
+    return size < 1 ? 1 : (size + tile_size - 1) / tile_size;
+}
+
+#endif
@@ -0,0 +1,41 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#ifndef WINDOWS_HPP
+#define WINDOWS_HPP
+
+#include <coati/gotoh.hpp>
+
+/* Window of the reference, seq_a[a0, a1), and the region of the query,
+ * seq_b[b0, b1), it is aligned against. Windows start at a codon of the
+ * reference. */
+struct window_t {
+    int a0, a1, b0, b1;
+};
+
+vector<window_t> split_windows(int m, int n, int window, int overlap);
+size_t windowed_bytes(int m, int n, int window, int threads = 1);
+int mg94_marginal_windowed(vector<string> sequences, alignment_t& aln,
+                           Matrix64f& P_m, int window = 3000, int threads = 1,
+                           const indel_params_t& indel = indel_params_t());
+
+#endif
@@ -24,24 +24,165 @@
 
 #include <coati/align.hpp>
 
-/* Alignment using dynamic programming implementation of marginal COATi model */
+/* DP functions of the marginal models with each gap policy (see
+ * gotoh_kernels.hpp). Only gaps of any length have the other DP modes. */
+template <class Gaps>
+struct marginal_dp_t;
+
+template <>
+struct marginal_dp_t<frameshift_gaps_t> {
+    static constexpr bool all_modes = true;
+    static constexpr auto full = &mg94_marginal;
+    static constexpr auto score_only = &mg94_marginal_score_only;
+    static constexpr auto banded = &mg94_marginal_banded;
+};
+
+template <>
+struct marginal_dp_t<codon_gaps_t> {
+    static constexpr bool all_modes = false;
+    static constexpr auto full = &gotoh_noframeshifts;
+    static constexpr auto score_only = &gotoh_noframeshifts_score_only;
+    static constexpr auto banded = &gotoh_noframeshifts_banded;
+};
+
+/* Alignment using dynamic programming implementation of marginal COATi model
+ * with gap policy Gaps */
+template <class Gaps>
 int mcoati(input_t& in_data, Matrix64f& P) {
+    using dp = marginal_dp_t<Gaps>;
     ofstream out_w;
     alignment_t aln;
     aln.f.seq_names = in_data.fasta_file.seq_names;
     aln.f.path = in_data.out_file;
 
     if(in_data.score) {
-        cout << alignment_score(in_data.fasta_file.seq_data, P) << endl;
+        cout << alignment_score(in_data.fasta_file.seq_data, P, in_data.indel)
+             << endl;
         return EXIT_SUCCESS;
     }
 
-    if(in_data.mut_model.compare("no_frameshifts") == 0) {
-        if(gotoh_noframeshifts(in_data.fasta_file.seq_data, aln, P) != 0) {
+    if(in_data.max_memory > 0 && plan_alignment(in_data) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // after planning, which may switch modes
+    if(in_data.x_drop > 0 &&
+       (in_data.score_only || !dp::all_modes ||
+        (!in_data.dp_mode.empty() && in_data.dp_mode.compare("full") != 0))) {
+        cerr << "X-drop is only available for full dynamic programming with "
+                "m-coati or m-ecm models. Exiting!"
+             << endl;
+        return EXIT_FAILURE;
+    }
+    if(in_data.x_drop > 0 && in_data.threads > 1) {
+        cerr << "X-drop runs on a single thread; --x-drop and --threads "
+                "cannot be combined. Exiting!"
+             << endl;
+        return EXIT_FAILURE;
+    }
+
+    band_t band;
+    if(in_data.score_only) {
+        if(dp::score_only(in_data.fasta_file.seq_data, aln, P,
+                          in_data.indel) != 0) {
+            return EXIT_FAILURE;
+        }
+    } else if(in_data.dp_mode.compare("banded") == 0) {
+        if(dp::banded(in_data.fasta_file.seq_data, aln, P, band,
+                      in_data.band_width, in_data.max_memory << 20,
+                      in_data.indel) != 0) {
+            return EXIT_FAILURE;
+        }
+        cerr << "Band " << band.lo << " to " << band.hi
+             << " of diagonals j - i: "
+             << (band.interior
+                     ? "path inside the band (a better path outside of it "
+                       "is not ruled out)."
+                     : "path reaches the band edge (--max-memory does not "
+                       "fit a wider band).")
+             << endl;
+    } else if(!dp::all_modes) {
+        if(!in_data.dp_mode.empty() && in_data.dp_mode.compare("full") != 0) {
+            cerr << "Dynamic programming mode '" << in_data.dp_mode
+                 << "' is not available for no_frameshifts model. Exiting!"
+                 << endl;
+            return EXIT_FAILURE;
+        }
+        if(dp::full(in_data.fasta_file.seq_data, aln, P, in_data.indel) !=
+           0) {
+            return EXIT_FAILURE;
+        }
+    } else if(in_data.dp_mode.compare("linear") == 0) {
+        if(mg94_marginal_linear(in_data.fasta_file.seq_data, aln, P,
+                                linear_base_cells, in_data.indel) != 0) {
+            return EXIT_FAILURE;
+        }
+    } else if(in_data.dp_mode.compare("checkpoint") == 0) {
+        if(mg94_marginal_checkpoint(in_data.fasta_file.seq_data, aln, P,
+                                    in_data.max_memory << 20, 0,
+                                    in_data.indel) != 0) {
+            return EXIT_FAILURE;
+        }
+    } else if(in_data.dp_mode.compare("anchored") == 0) {
+        if(mg94_marginal_anchored(in_data.fasta_file.seq_data, aln, P,
+                                  in_data.seed_length, in_data.threads,
+                                  in_data.indel) != 0) {
+            return EXIT_FAILURE;
+        }
+    } else if(in_data.dp_mode.compare("windowed") == 0) {
+        if(mg94_marginal_windowed(in_data.fasta_file.seq_data, aln, P,
+                                  in_data.window, in_data.threads,
+                                  in_data.indel) != 0) {
+            return EXIT_FAILURE;
+        }
+    } else if(in_data.dp_mode.compare("coarse") == 0) {
+        if(mg94_marginal_coarse(in_data.fasta_file.seq_data, aln, P,
+                                in_data.indel) != 0) {
+            return EXIT_FAILURE;
+        }
+    } else if(in_data.dp_mode.compare("runs") == 0) {
+        if(mg94_marginal_runs(in_data.fasta_file.seq_data, aln, P,
+                              in_data.threads, in_data.indel) != 0) {
+            return EXIT_FAILURE;
+        }
+    } else if(in_data.dp_mode.compare("disk") == 0) {
+        string temp_dir =
+            in_data.temp_dir.empty()
+                ? boost::filesystem::temp_directory_path().string()
+                : in_data.temp_dir;
+        // without a limit keep up to 1 GB of backtracking rows mapped
+        size_t max_memory =
+            in_data.max_memory == 0 ? size_t{1} << 30 : in_data.max_memory << 20;
+        try {
+            if(mg94_marginal_scratch(in_data.fasta_file.seq_data, aln, P,
+                                     temp_dir, max_memory,
+                                     in_data.indel) != 0) {
+                return EXIT_FAILURE;
+            }
+        } catch(const std::runtime_error& e) {
+            cerr << e.what() << ". Exiting!" << endl;
+            return EXIT_FAILURE;
+        }
+    } else if(in_data.x_drop > 0) {
+        size_t cells = 0;
+        if(mg94_marginal_xdrop(in_data.fasta_file.seq_data, aln, P,
+                               in_data.x_drop, cells, in_data.indel) != 0) {
+            return EXIT_FAILURE;
+        }
+        size_t total = in_data.fasta_file.seq_data[0].length() *
+                       in_data.fasta_file.seq_data[1].length();
+        cerr << "X-drop filled " << cells << " of " << total
+             << " DP cells (" << 100.0 * cells / max<size_t>(total, 1) << "%)."
+             << endl;
+    } else if(in_data.threads > 1) {
+        if(mg94_marginal_tiled(in_data.fasta_file.seq_data, aln, P,
+                               in_data.threads, wavefront_tile,
+                               in_data.indel) != 0) {
             return EXIT_FAILURE;
         }
     } else {
-        if(mg94_marginal(in_data.fasta_file.seq_data, aln, P) != 0) {
+        if(dp::full(in_data.fasta_file.seq_data, aln, P, in_data.indel) !=
+           0) {
             return EXIT_FAILURE;
         }
     }
@@ -54,6 +195,180 @@ int mcoati(input_t& in_data, Matrix64f& P) {
         out_w.close();
     }
 
+    if(in_data.score_only) {
+        if(in_data.weight_file.empty()) {
+            cout << aln.weight << endl;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // write alignment
+    if(boost::filesystem::extension(aln.f.path) == ".fasta") {
+        return write_fasta(aln.f);
+    } else {
+        return write_phylip(aln.f);
+    }
+}
+
+/* Alignment using dynamic programming implementation of marginal COATi model
+ */
+int mcoati(input_t& in_data, Matrix64f& P) {
+    // gap policy is resolved once: whole codons only for no_frameshifts
+    return in_data.mut_model.compare("no_frameshifts") == 0
+               ? mcoati<codon_gaps_t>(in_data, P)
+               : mcoati<frameshift_gaps_t>(in_data, P);
+}
+
+/* Align consecutive pairs of sequences (reference first) of the input fasta
+ * file with the batch kernel of marginal COATi model. Aligned pairs are
+ * written to a single fasta file in input order. */
+int mcoati_batch(input_t& in_data, Matrix64f& P) {
+    const fasta_t& input = in_data.fasta_file;
+
+    if(in_data.mut_model.compare("no_frameshifts") == 0 || in_data.score ||
+       in_data.score_only ||
+       (!in_data.dp_mode.empty() && in_data.dp_mode.compare("full") != 0)) {
+        cerr << "Batch alignment is only available for full dynamic "
+                "programming with m-coati or m-ecm models. Exiting!"
+             << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<vector<string>> pairs;
+    for(size_t k = 0; k + 1 < input.seq_data.size(); k += 2) {
+        pairs.push_back({input.seq_data[k], input.seq_data[k + 1]});
+    }
+
+    vector<alignment_t> alns;
+    if(mg94_marginal_batch(pairs, alns, P, in_data.indel) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if(!in_data.weight_file.empty()) {
+        // append weight and fasta file name to file, one line per pair
+        ofstream out_w;
+        out_w.open(in_data.weight_file, ios::app | ios::out);
+        for(auto& aln : alns) {
+            out_w << input.path << "," << in_data.mut_model << ","
+                  << aln.weight << endl;
+        }
+        out_w.close();
+    }
+
+    // write alignments
+    fasta_t out(in_data.out_file);
+    for(size_t k = 0; k < alns.size(); k++) {
+        for(int s = 0; s < 2; s++) {
+            out.seq_names.push_back(input.seq_names[2 * k + s]);
+            out.seq_data.push_back(alns[k].f.seq_data[s]);
+        }
+    }
+    return write_fasta(out);
+}
+
+/* Align the two input sequences with the marginal COATi model at every
+ * evolutionary time of in_data.br_lens in a single sweep of the DP matrices
+ * and write the alignment of the best one. Weights are reported per time. */
+int mcoati_evo_times(input_t& in_data) {
+    const vector<double>& times = in_data.br_lens;
+
+    if((in_data.mut_model.compare("m-coati") != 0 &&
+        in_data.mut_model.compare("m-ecm") != 0) ||
+       !in_data.rate.empty() || in_data.score || in_data.score_only ||
+       in_data.batch ||
+       (!in_data.dp_mode.empty() && in_data.dp_mode.compare("full") != 0)) {
+        cerr << "Multiple evolutionary times are only available for full "
+                "dynamic programming with m-coati or m-ecm models. Exiting!"
+             << endl;
+        return EXIT_FAILURE;
+    }
+
+    Matrix64f Q;
+    if(in_data.mut_model.compare("m-ecm") == 0) {
+        ecm_q(Q);
+    } else {  // m-coati
+        mg94_q(Q);
+    }
+    p_engine_t engine(Q);
+    vector<Matrix64f> P_ms(times.size());
+    for(size_t k = 0; k < times.size(); k++) {
+        engine.p(times[k], P_ms[k]);
+    }
+
+    alignment_t aln;
+    aln.f.seq_names = in_data.fasta_file.seq_names;
+    aln.f.path = in_data.out_file;
+    vector<float> weights;
+    if(mg94_marginal_branches(in_data.fasta_file.seq_data, aln, P_ms,
+                              weights, in_data.indel) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if(!in_data.weight_file.empty()) {
+        // append weight and fasta file name to file, one line per time
+        ofstream out_w;
+        out_w.open(in_data.weight_file, ios::app | ios::out);
+        for(size_t k = 0; k < times.size(); k++) {
+            out_w << in_data.fasta_file.path << "," << in_data.mut_model << ","
+                  << weights[k] << "," << times[k] << endl;
+        }
+        out_w.close();
+    } else {
+        for(size_t k = 0; k < times.size(); k++) {
+            cout << times[k] << "\t" << weights[k] << endl;
+        }
+    }
+
+    // write alignment
+    if(boost::filesystem::extension(aln.f.path) == ".fasta") {
+        return write_fasta(aln.f);
+    } else {
+        return write_phylip(aln.f);
+    }
+}
+
+/* Align the two input sequences with the marginal COATi model at the
+ * maximum-likelihood evolutionary time, estimated starting from in_data.br_len
+ * (see estimate_branch_length) */
+int mcoati_estimate_time(input_t& in_data) {
+    if((in_data.mut_model.compare("m-coati") != 0 &&
+        in_data.mut_model.compare("m-ecm") != 0) ||
+       !in_data.rate.empty() || in_data.score || in_data.score_only ||
+       in_data.batch ||
+       (!in_data.dp_mode.empty() && in_data.dp_mode.compare("full") != 0)) {
+        cerr << "Evolutionary time estimation is only available for full "
+                "dynamic programming with m-coati or m-ecm models. Exiting!"
+             << endl;
+        return EXIT_FAILURE;
+    }
+
+    Matrix64f Q;
+    if(in_data.mut_model.compare("m-ecm") == 0) {
+        ecm_q(Q);
+    } else {  // m-coati
+        mg94_q(Q);
+    }
+    p_engine_t engine(Q);
+
+    alignment_t aln;
+    aln.f.seq_names = in_data.fasta_file.seq_names;
+    aln.f.path = in_data.out_file;
+    if(estimate_branch_length(in_data.fasta_file.seq_data, aln, engine,
+                              in_data.br_len, in_data.indel) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if(!in_data.weight_file.empty()) {
+        // append weight, fasta file name, and estimated time to file
+        ofstream out_w;
+        out_w.open(in_data.weight_file, ios::app | ios::out);
+        out_w << in_data.fasta_file.path << "," << in_data.mut_model << ","
+              << aln.weight << "," << in_data.br_len << endl;
+        out_w.close();
+    } else {
+        cout << in_data.br_len << "\t" << aln.weight << endl;
+    }
+
     // write alignment
     if(boost::filesystem::extension(aln.f.path) == ".fasta") {
         return write_fasta(aln.f);
@@ -62,6 +377,161 @@ int mcoati(input_t& in_data, Matrix64f& P) {
     }
 }
 
+/* Estimated bytes used by dynamic programming mode dp_mode (full, linear,
+ * checkpoint, banded, disk, anchored, windowed, coarse, runs, or score-only)
+ * to align the two input sequences */
+size_t dp_memory_estimate(const input_t& in_data, const string& dp_mode) {
+    int m = in_data.fasta_file.seq_data[0].length();
+    int n = in_data.fasta_file.seq_data[1].length();
+    bool noframeshifts = in_data.mut_model.compare("no_frameshifts") == 0;
+    size_t budget = in_data.max_memory << 20;
+    size_t cell = 3 * sizeof(float) + 3 * sizeof(int);  // rolling/band cell
+    size_t line = 3 * sizeof(float) + sizeof(int);      // dp_line_t cell
+
+    if(dp_mode.compare("score-only") == 0) {
+        int rows = noframeshifts ? 4 : 2, cols = noframeshifts ? 3 : 1;
+        return cell * (static_cast<size_t>(rows) * (n + 1) +
+                       static_cast<size_t>(cols) * (m + 1));
+    } else if(dp_mode.compare("linear") == 0) {
+        // rows of the recursion and one base block
+        return line * (8 * static_cast<size_t>(n + 1) + 4 * (m + 1)) +
+               linear_base_cells * 3 * sizeof(int);
+    } else if(dp_mode.compare("checkpoint") == 0) {
+        return checkpoint_bytes(m, n, checkpoint_interval(m, n, budget));
+    } else if(dp_mode.compare("disk") == 0) {
+        size_t resident = line * (2 * static_cast<size_t>(n + 1) + m + 1);
+        size_t traceback = (m + 1) * traceback_t::stride(n + 1);
+        return resident +
+               min(traceback, budget > resident ? budget - resident
+                                                : traceback_t::stride(n + 1));
+    } else if(dp_mode.compare("anchored") == 0) {
+        return anchored_bytes(in_data.fasta_file.seq_data[0],
+                              in_data.fasta_file.seq_data[1],
+                              in_data.seed_length);
+    } else if(dp_mode.compare("windowed") == 0) {
+        return windowed_bytes(m, n, in_data.window, in_data.threads);
+    } else if(dp_mode.compare("runs") == 0) {
+        return runs_bytes(in_data.fasta_file.seq_data[0],
+                          in_data.fasta_file.seq_data[1]);
+    } else if(dp_mode.compare("coarse") == 0) {
+        // codon backtracking info and a band of nominal width
+        return (m / 3 + 1) * traceback_t::stride(n / 3 + 1) +
+               cell * (m + 1) *
+                   static_cast<size_t>(2 * coarse_margin + 1 + abs(n - m));
+    } else if(dp_mode.compare("banded") == 0) {
+        // initial band, which may be widened up to --max-memory
+        int lo, hi;
+        if(in_data.band_width > 0) {
+            lo = max(min(0, n - m) - in_data.band_width, -m);
+            hi = min(max(0, n - m) + in_data.band_width, n);
+        } else {
+            estimate_band(in_data.fasta_file.seq_data[0],
+                          in_data.fasta_file.seq_data[1], lo, hi);
+        }
+        return banded_bytes(m, lo, hi);
+    }
+    size_t traceback = (m + 1) * traceback_t::stride(n + 1);
+    if(noframeshifts) {
+        // backtracking info of reachable cells and four rows of D, P, Q
+        return (m + 1) * traceback_t::stride(n / 3 + 1) +
+               4 * 3 * sizeof(float) * static_cast<size_t>(n + 1);
+    } else if(in_data.threads > 1) {
+        // last row and column of each row and column of tiles
+        return traceback + line * (static_cast<size_t>(wavefront_tiles(m)) *
+                                       (n + 1) +
+                                   static_cast<size_t>(wavefront_tiles(n)) *
+                                       (m + 1));
+    }
+    // three anti-diagonals of D, P, Q, Bd and the emission table
+    return traceback + 3 * 4 * sizeof(double) * static_cast<size_t>(m + 9) +
+           5 * sizeof(double) * static_cast<size_t>(m + 8);
+}
+
+/* Estimate the memory of the requested alignment mode and, if it exceeds
+ * --max-memory, switch to a mode that recomputes blocks of the DP instead
+ * (checkpoint, or linear if checkpoints do not fit either). The estimate and
+ * decision are logged to stderr. */
+int plan_alignment(input_t& in_data) {
+    auto mb = [](size_t bytes) { return (bytes + (1 << 20) - 1) >> 20; };
+    string mode = in_data.score_only      ? "score-only"
+                  : in_data.dp_mode.empty() ? "full"
+                                            : in_data.dp_mode;
+    size_t budget = in_data.max_memory << 20;
+    size_t bytes = dp_memory_estimate(in_data, mode);
+
+    cerr << "Estimated memory for " << mode << " alignment: " << mb(bytes)
+         << " MB (limit " << in_data.max_memory << " MB)." << endl;
+    if(bytes <= budget || mode.compare("score-only") == 0 ||
+       mode.compare("linear") == 0 || mode.compare("disk") == 0) {
+        cerr << "Using " << mode << " alignment." << endl;
+        return EXIT_SUCCESS;
+    }
+
+    if(in_data.mut_model.compare("no_frameshifts") == 0) {
+        cerr << "Memory limit exceeded and no low-memory mode is available "
+                "for no_frameshifts model. Exiting!"
+             << endl;
+        return EXIT_FAILURE;
+    }
+    if(in_data.x_drop > 0) {
+        cerr << "Memory limit exceeded and no low-memory mode is available "
+                "with --x-drop. Exiting!"
+             << endl;
+        return EXIT_FAILURE;
+    }
+
+    size_t checkpoint = dp_memory_estimate(in_data, "checkpoint");
+    in_data.dp_mode = checkpoint <= budget ? "checkpoint" : "linear";
+    cerr << "Using " << in_data.dp_mode << " alignment instead (estimated "
+         << mb(dp_memory_estimate(in_data, in_data.dp_mode)) << " MB)."
+         << endl;
+    return EXIT_SUCCESS;
+}
+
+TEST_CASE("[align.cc] plan_alignment") {
+    input_t input_data;
+    input_data.mut_model = "m-coati";
+    input_data.dp_mode = "full";
+    input_data.fasta_file.seq_data = {string(12000, 'A'), string(12000, 'C')};
+
+    // the full traceback takes about 138 MB
+    CHECK(dp_memory_estimate(input_data, "full") > (100 << 20));
+    CHECK(dp_memory_estimate(input_data, "checkpoint") < (20 << 20));
+    CHECK(dp_memory_estimate(input_data, "score-only") < (1 << 20));
+
+    SUBCASE("fits") {
+        input_data.max_memory = 200;
+        REQUIRE(plan_alignment(input_data) == 0);
+        CHECK(input_data.dp_mode == "full");
+    }
+    SUBCASE("checkpoint") {
+        input_data.max_memory = 50;
+        REQUIRE(plan_alignment(input_data) == 0);
+        CHECK(input_data.dp_mode == "checkpoint");
+    }
+    SUBCASE("linear") {
+        input_data.max_memory = 1;
+        REQUIRE(plan_alignment(input_data) == 0);
+        CHECK(input_data.dp_mode == "linear");
+    }
+    SUBCASE("no_frameshifts") {
+        // only reachable cells are stored, about a third of the traceback
+        input_data.mut_model = "no_frameshifts";
+        CHECK(dp_memory_estimate(input_data, "full") < (50 << 20));
+        input_data.max_memory = 50;
+        CHECK(plan_alignment(input_data) == 0);
+        input_data.max_memory = 20;
+        CHECK(plan_alignment(input_data) == EXIT_FAILURE);
+    }
+    SUBCASE("x-drop") {
+        // X-drop needs the full traceback and is not replaced
+        input_data.x_drop = 20;
+        input_data.max_memory = 50;
+        CHECK(plan_alignment(input_data) == EXIT_FAILURE);
+        CHECK(input_data.dp_mode == "full");
+    }
+}
+
 TEST_CASE("[align.cc] mcoati") {
     input_t input_data;
     input_data.br_len = 0.0133;
@@ -100,6 +570,39 @@ TEST_CASE("[align.cc] mcoati") {
         CHECK(s.substr(s.length() - 7) == "9.29064");
     }
 
+    SUBCASE("X-drop with threads") {
+        input_data.fasta_file.path = "../../fasta/example-001.fasta";
+        input_data.mut_model = "m-coati";
+        input_data.x_drop = 20;
+        input_data.threads = 2;
+        REQUIRE(read_fasta(input_data.fasta_file) == 0);
+        CHECK(mcoati(input_data, P) == EXIT_FAILURE);
+    }
+
+    SUBCASE("Score only") {
+        input_data.fasta_file.path = "../../fasta/example-001.fasta";
+        input_data.out_file = "example-001.fasta";
+        input_data.mut_model = "m-coati";
+        input_data.weight_file = "score.log";
+        input_data.score_only = true;
+
+        if(boost::filesystem::exists(input_data.out_file))
+            boost::filesystem::remove(input_data.out_file);
+        if(boost::filesystem::exists(input_data.weight_file))
+            boost::filesystem::remove(input_data.weight_file);
+
+        REQUIRE(read_fasta(input_data.fasta_file) == 0);
+        REQUIRE(mcoati(input_data, P) == 0);
+
+        CHECK_FALSE(boost::filesystem::exists(input_data.out_file));
+
+        ifstream infile(input_data.weight_file);
+        string s;
+        infile >> s;
+        CHECK(boost::filesystem::remove("score.log"));
+        CHECK(s.substr(s.length() - 7) == "9.29064");
+    }
+
     SUBCASE("Alignment with frameshifts (default) - output phylip") {
         input_data.fasta_file.path = "../../fasta/example-001.fasta";
         input_data.out_file = "example-001.phy";
@@ -168,6 +671,67 @@ TEST_CASE("[align.cc] mcoati") {
 
         CHECK(alignment_score(result.seq_data, P) == doctest::Approx(9.29064));
     }
+
+    SUBCASE("Banded alignment") {
+        input_data.fasta_file.path = "../../fasta/example-001.fasta";
+        input_data.out_file = "example-001.fasta";
+        input_data.mut_model = "m-coati";
+        input_data.dp_mode = "banded";
+        result.path = input_data.out_file;
+
+        if(boost::filesystem::exists(input_data.out_file))
+            boost::filesystem::remove(input_data.out_file);
+
+        REQUIRE(read_fasta(input_data.fasta_file) == 0);
+        REQUIRE(mcoati(input_data, P) == 0);
+        REQUIRE(read_fasta(result) == 0);
+
+        CHECK(boost::filesystem::remove(input_data.out_file));
+
+        CHECK(result.seq_data[0] == "CTCTGGATAGTG");
+        CHECK(result.seq_data[1] == "CT----ATAGTG");
+    }
+
+    SUBCASE("Alignment in linear memory") {
+        input_data.fasta_file.path = "../../fasta/example-001.fasta";
+        input_data.out_file = "example-001.fasta";
+        input_data.mut_model = "m-coati";
+        input_data.dp_mode = "linear";
+        result.path = input_data.out_file;
+
+        if(boost::filesystem::exists(input_data.out_file))
+            boost::filesystem::remove(input_data.out_file);
+
+        REQUIRE(read_fasta(input_data.fasta_file) == 0);
+        REQUIRE(mcoati(input_data, P) == 0);
+        REQUIRE(read_fasta(result) == 0);
+
+        CHECK(boost::filesystem::remove(input_data.out_file));
+
+        CHECK(result.seq_data[0] == "CTCTGGATAGTG");
+        CHECK(result.seq_data[1] == "CT----ATAGTG");
+    }
+
+    SUBCASE("Alignment with backtracking info on disk") {
+        input_data.fasta_file.path = "../../fasta/example-001.fasta";
+        input_data.out_file = "example-001.fasta";
+        input_data.mut_model = "m-coati";
+        input_data.dp_mode = "disk";
+        input_data.max_memory = 1;
+        result.path = input_data.out_file;
+
+        if(boost::filesystem::exists(input_data.out_file))
+            boost::filesystem::remove(input_data.out_file);
+
+        REQUIRE(read_fasta(input_data.fasta_file) == 0);
+        REQUIRE(mcoati(input_data, P) == 0);
+        REQUIRE(read_fasta(result) == 0);
+
+        CHECK(boost::filesystem::remove(input_data.out_file));
+
+        CHECK(result.seq_data[0] == "CTCTGGATAGTG");
+        CHECK(result.seq_data[1] == "CT----ATAGTG");
+    }
 }
 
 /* Alignment using FST library*/
@@ -187,7 +751,7 @@ int fst_alignment(input_t& in_data, vector<VectorFst<StdArc>>& fsts) {
 
     // get indel FST
     VectorFst<StdArc> indel_fst;
-    indel(indel_fst, in_data.mut_model);
+    indel(indel_fst, in_data.mut_model, in_data.indel);
 
     // sort mutation and indel FSTs
     VectorFst<StdArc> mutation_sort, indel_sort;
@@ -426,6 +990,15 @@ int ref_indel_alignment(input_t& in_data) {
     nodes_ins[ref_pos] = insertion_data_t(
         ref_seq, in_data.ref, SparseVectorInt(2 * ref_seq.length()));
 
+    // substitution model, decomposed once and shared by all branches
+    Matrix64f Q;
+    if(in_data.mut_model.compare("m-ecm") == 0) {
+        ecm_q(Q);
+    } else {  // m-coati
+        mg94_q(Q);
+    }
+    p_engine_t engine(Q);
+
     // pairwise alignment for each leaf
     string node_seq;
     for(int node = 0; node < tree.size(); node++) {
@@ -440,14 +1013,10 @@ int ref_indel_alignment(input_t& in_data) {
             pair_seqs[1] = node_seq;
 
             // P matrix
-            if(in_data.mut_model.compare("m-ecm") == 0) {
-                ecm_p(P, branch);
-            } else {  // m-coati
-                mg94_p(P, branch);
-            }
+            P = engine.p(branch);
 
             aln_tmp.f.seq_data.clear();
-            if(mg94_marginal(pair_seqs, aln_tmp, P) != 0) {
+            if(mg94_marginal(pair_seqs, aln_tmp, P, in_data.indel) != 0) {
                 cout << "Error: aligning reference " << in_data.ref << " and "
                      << tree[node].label << endl;
             }
@@ -588,7 +1157,8 @@ TEST_CASE("[align.cc] ref_indel_alignment") {
     }
 }
 
-float alignment_score(vector<string> alignment, Matrix64f& P) {
+float alignment_score(vector<string> alignment, Matrix64f& P,
+                      const indel_params_t& indel) {
     if(alignment[0].length() != alignment[1].length()) {
         cout << "For alignment scoring both sequences must have equal lenght. "
                 "Exiting!"
@@ -598,12 +1168,6 @@ float alignment_score(vector<string> alignment, Matrix64f& P) {
 
     int state = 0;
     double weight = 0.0;
-    string codon;
-
-    double insertion = 0.001;
-    double deletion = 0.001;
-    double insertion_ext = 1.0 - (1.0 / 6.0);
-    double deletion_ext = 1.0 - (1.0 / 6.0);
 
     // P matrix for marginal Muse and Gaut codon model
     Eigen::Tensor<double, 3> p(64, 3, 4);
@@ -611,50 +1175,47 @@ float alignment_score(vector<string> alignment, Matrix64f& P) {
 
     string seq1 = alignment[0];
     boost::erase_all(seq1, "-");
+    score_model_t model(seq1, p, indel);
     int gap_n = 0;
 
-    Vector5d nuc_freqs;
-    nuc_freqs << 0.308, 0.185, 0.199, 0.308, 0.25;
-
     for(int i = 0; i < alignment[0].length(); i++) {
-        codon = seq1.substr(((i - gap_n) / 3) * 3, 3);  // current codon
+        // reference position (1-based) of the current column
+        int pos = i + 1 - gap_n;
         switch(state) {
         case 0:
             if(alignment[0][i] == '-') {
                 // insertion;
-                weight = weight - log(insertion) -
-                         log(nuc_freqs[nt4_table[alignment[1][i]]]) -
-                         log(1.0 - insertion_ext);
+                weight = weight + model.insertion +
+                         model.nuc_freq(alignment[1][i]) +
+                         model.no_insertion_ext;
                 state = 1;
                 gap_n++;
             } else if(alignment[1][i] == '-') {
                 // deletion;
-                weight = weight - log(1.0 - insertion) - log(deletion) -
-                         log(1.0 - deletion_ext);
+                weight = weight + model.no_insertion + model.deletion +
+                         model.no_deletion_ext;
                 state = 2;
             } else {
                 // match/mismatch;
-                weight = weight - log(1.0 - insertion) - log(1.0 - deletion) -
-                         log(transition(codon, (i + 1 - gap_n) % 3,
-                                        alignment[1][i], p));
+                weight = weight + model.no_insertion + model.no_deletion +
+                         model.emission(pos, alignment[1][i]);
             }
             break;
 
         case 1:
             if(alignment[0][i] == '-') {
                 // insertion_ext
-                weight = weight - log(insertion_ext) -
-                         log(nuc_freqs[nt4_table[alignment[1][i]]]);
+                weight = weight + model.insertion_ext +
+                         model.nuc_freq(alignment[1][i]);
                 gap_n++;
             } else if(alignment[1][i] == '-') {
                 // deletion
-                weight = weight - log(deletion) - log(1.0 - deletion_ext);
+                weight = weight + model.deletion + model.no_deletion_ext;
                 state = 2;
             } else {
                 // match/mismatch
-                weight = weight - log(1.0 - deletion) -
-                         log(transition(codon, (i + 1 - gap_n) % 3,
-                                        alignment[1][i], p));
+                weight = weight + model.no_deletion +
+                         model.emission(pos, alignment[1][i]);
                 state = 0;
             }
             break;
@@ -665,11 +1226,10 @@ float alignment_score(vector<string> alignment, Matrix64f& P) {
                 exit(EXIT_FAILURE);
             } else if(alignment[1][i] == '-') {
                 // deletion_ext
-                weight = weight - log(deletion_ext);
+                weight = weight + model.deletion_ext;
             } else {
                 // match/mismatch
-                weight = weight - log(transition(codon, (i + 1 - gap_n) % 3,
-                                                 alignment[1][i], p));
+                weight = weight + model.emission(pos, alignment[1][i]);
                 state = 0;
             }
         }
@@ -0,0 +1,749 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <coati/align.hpp>
+#include <coati/anchors.hpp>
+#include <unordered_map>
+
+/* Exact matches of k nucleotides (k a multiple of 3, at most 30) between a
+ * k-mer starting at a codon of seq_a and any position of seq_b. K-mers that
+ * occur more than once in seq_a or match more than once in seq_b are ignored.
+ * Matches on the same diagonal at consecutive codons are merged into a single
+ * anchor. Anchors are sorted by position in seq_a. */
+vector<anchor_t> find_anchors(const string& seq_a, const string& seq_b,
+                              int k) {
+    const uint64_t mask = (uint64_t{1} << (2 * k)) - 1;
+    const int none = -2, repeated = -1;
+    int m = seq_a.length();
+    int n = seq_b.length();
+
+    // codon-phase k-mers of the reference by start position
+    unordered_map<uint64_t, int> index;
+    uint64_t kmer = 0;
+    int len = 0;
+    for(int i = 0; i < m; i++) {
+        uint8_t nuc = nt4_table[static_cast<uint8_t>(seq_a[i])];
+        if(nuc > 3) {  // N or other ambiguous nucleotide
+            len = 0;
+            continue;
+        }
+        kmer = ((kmer << 2) | nuc) & mask;
+        int start = i - k + 1;
+        if(++len < k || start % 3 != 0) continue;
+        auto [it, inserted] = index.emplace(kmer, start);
+        if(!inserted) it->second = repeated;
+    }
+
+    // position in seq_b matching the k-mer at each codon of seq_a
+    vector<int> hit(m / 3 + 1, none);
+    kmer = 0;
+    len = 0;
+    for(int j = 0; j < n; j++) {
+        uint8_t nuc = nt4_table[static_cast<uint8_t>(seq_b[j])];
+        if(nuc > 3) {
+            len = 0;
+            continue;
+        }
+        kmer = ((kmer << 2) | nuc) & mask;
+        if(++len < k) continue;
+        auto it = index.find(kmer);
+        if(it == index.end() || it->second == repeated) continue;
+        int& h = hit[it->second / 3];
+        h = h == none ? j - k + 1 : repeated;
+    }
+
+    // merge matches of consecutive codons on the same diagonal
+    vector<anchor_t> anchors;
+    for(int c = 0; c < static_cast<int>(hit.size()); c++) {
+        if(hit[c] < 0) continue;
+        int a = 3 * c, b = hit[c];
+        if(!anchors.empty()) {
+            anchor_t& last = anchors.back();
+            if(a + k - last.a - last.length == 3 && b - last.b == a - last.a) {
+                last.length += 3;
+                continue;
+            }
+        }
+        anchors.push_back({a, b, k});
+    }
+    return anchors;
+}
+
+/* Collinear subset of anchors that do not overlap in either sequence and
+ * cover the most nucleotides, found with a Fenwick tree over end positions in
+ * seq_b. Anchors are first shortened by margin nucleotides (rounded down to
+ * whole codons) on each side, leaving the placement of gaps next to them to
+ * the DP. */
+vector<anchor_t> chain_anchors(vector<anchor_t> anchors, int margin) {
+    margin -= margin % 3;
+    vector<anchor_t> trimmed;
+    for(const auto& x : anchors) {
+        if(x.length - 2 * margin >= 3) {
+            trimmed.push_back({x.a + margin, x.b + margin,
+                               x.length - 2 * margin});
+        }
+    }
+    if(trimmed.empty()) {
+        return trimmed;
+    }
+    std::sort(trimmed.begin(), trimmed.end(),
+              [](const anchor_t& x, const anchor_t& y) { return x.a < y.a; });
+
+    // anchors in order of end in seq_a, added to the tree once they end
+    // before the start of the anchor being chained
+    vector<int> by_end(trimmed.size());
+    for(size_t x = 0; x < trimmed.size(); x++) by_end[x] = x;
+    std::sort(by_end.begin(), by_end.end(), [&](int x, int y) {
+        return trimmed[x].a + trimmed[x].length <
+               trimmed[y].a + trimmed[y].length;
+    });
+    int size = 0;
+    for(const auto& x : trimmed) size = max(size, x.b + x.length + 1);
+
+    // best chain (covered length, last anchor) ending at or before each
+    // position of seq_b
+    vector<pair<long, int>> tree(size + 1, {0, -1});
+    auto update = [&](int pos, pair<long, int> value) {
+        for(pos++; pos <= size; pos += pos & -pos) {
+            tree[pos] = max(tree[pos], value);
+        }
+    };
+    auto query = [&](int pos) {
+        pair<long, int> best{0, -1};
+        for(pos++; pos > 0; pos -= pos & -pos) best = max(best, tree[pos]);
+        return best;
+    };
+
+    vector<long> score(trimmed.size());
+    vector<int> prev(trimmed.size());
+    size_t added = 0;
+    for(size_t x = 0; x < trimmed.size(); x++) {
+        for(; added < by_end.size(); added++) {
+            const anchor_t& y = trimmed[by_end[added]];
+            if(y.a + y.length > trimmed[x].a) break;
+            update(y.b + y.length, {score[by_end[added]], by_end[added]});
+        }
+        auto best = query(trimmed[x].b);
+        score[x] = best.first + trimmed[x].length;
+        prev[x] = best.second;
+    }
+
+    vector<anchor_t> chain;
+    int x = std::max_element(score.begin(), score.end()) - score.begin();
+    for(; x != -1; x = prev[x]) chain.push_back(trimmed[x]);
+    std::reverse(chain.begin(), chain.end());
+    return chain;
+}
+
+/* Estimated memory of mg94_marginal_anchored: the backtracking info of the
+ * largest segment between anchors */
+size_t anchored_bytes(const string& seq_a, const string& seq_b, int k) {
+    vector<anchor_t> chain = chain_anchors(find_anchors(seq_a, seq_b, k));
+    chain.push_back({static_cast<int>(seq_a.length()),
+                     static_cast<int>(seq_b.length()), 0});
+    size_t bytes = 0;
+    int a = 0, b = 0;
+    for(const auto& x : chain) {
+        bytes = max(bytes, (x.a - a + 1) * traceback_t::stride(x.b - b + 1));
+        a = x.a + x.length;
+        b = x.b + x.length;
+    }
+    return bytes;
+}
+
+/* Align the segments before each anchor s of chain (the last one ends the
+ * sequences) for which todo[s] is set with mg94_marginal on up to threads
+ * threads, leaving the other parts as they are. Segments start and end at
+ * codons of the reference. */
+static int align_segments(const string& seq_a, const string& seq_b,
+                          const vector<anchor_t>& chain,
+                          const vector<bool>& todo, vector<alignment_t>& parts,
+                          Matrix64f& P_m, int threads,
+                          const indel_params_t& indel) {
+    parts.resize(chain.size());
+    vector<int> status(chain.size(), 0);
+    parallel_tasks(chain.size(), threads, [&](int s) {
+        if(!todo[s]) return;
+        parts[s] = alignment_t();
+        int a = s == 0 ? 0 : chain[s - 1].a + chain[s - 1].length;
+        int b = s == 0 ? 0 : chain[s - 1].b + chain[s - 1].length;
+        string sub_a = seq_a.substr(a, chain[s].a - a);
+        string sub_b = seq_b.substr(b, chain[s].b - b);
+        if(sub_a.empty() || sub_b.empty()) {
+            // only insertions or deletions
+            parts[s].f.seq_data = {sub_a + string(sub_b.length(), '-'),
+                                   string(sub_a.length(), '-') + sub_b};
+            return;
+        }
+        status[s] = mg94_marginal({sub_a, sub_b}, parts[s], P_m, indel);
+    });
+    for(int st : status) {
+        if(st != 0) return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+/* Join the segment alignments and the anchors between them */
+static void stitch_segments(const string& seq_a, const string& seq_b,
+                            const vector<anchor_t>& chain,
+                            const vector<alignment_t>& parts,
+                            alignment_t& aln) {
+    aln.f.seq_data = {string(), string()};
+    for(size_t s = 0; s < chain.size(); s++) {
+        aln.f.seq_data[0] += parts[s].f.seq_data[0];
+        aln.f.seq_data[1] += parts[s].f.seq_data[1];
+        aln.f.seq_data[0] += seq_a.substr(chain[s].a, chain[s].length);
+        aln.f.seq_data[1] += seq_b.substr(chain[s].b, chain[s].length);
+    }
+}
+
+/* Seed-and-extend marginal MG94 alignment. Exact k-mer matches between the
+ * sequences are chained into collinear anchors (see find_anchors and
+ * chain_anchors), aligned as matches. The segments between consecutive
+ * anchors start and end at codons of the reference and are aligned with
+ * mg94_marginal as independent problems on up to threads threads. The weight
+ * is that of the whole stitched alignment. */
+int mg94_marginal_anchored(vector<string> sequences, alignment_t& aln,
+                           Matrix64f& P_m, int k, int threads,
+                           const indel_params_t& indel) {
+    const string& seq_a = sequences[0];
+    const string& seq_b = sequences[1];
+    int m = seq_a.length();
+    int n = seq_b.length();
+
+    if(check_codon_lengths(sequences) != 0) {
+        return EXIT_FAILURE;
+    }
+    if(k < 3 || k > 30 || k % 3 != 0) {
+        cerr << "Seed length must be a multiple of 3 between 3 and 30 (" << k
+             << "). Exiting!" << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<anchor_t> chain = chain_anchors(find_anchors(seq_a, seq_b, k));
+    chain.push_back({m, n, 0});  // end of the last segment
+
+    // segments before each anchor
+    vector<alignment_t> parts;
+    if(align_segments(seq_a, seq_b, chain, vector<bool>(chain.size(), true),
+                      parts, P_m, threads, indel) != 0) {
+        return EXIT_FAILURE;
+    }
+    stitch_segments(seq_a, seq_b, chain, parts, aln);
+    aln.weight = alignment_score(aln.f.seq_data, P_m, indel);
+
+    return 0;
+}
+
+/* Interiors of the exact matches of at least min_run nucleotides that start
+ * at a codon of both sequences and lie on the collinear chain of anchors
+ * (see find_anchors and chain_anchors). pad nucleotides at each end of a run
+ * are left out, to be aligned with the segments next to it. */
+vector<anchor_t> identity_runs(const string& seq_a, const string& seq_b,
+                               int min_run, int pad) {
+    vector<anchor_t> runs;
+    for(const auto& x : chain_anchors(find_anchors(seq_a, seq_b, 30), 0)) {
+        if(x.length < max(min_run, 2 * pad + 3) || (x.b - x.a) % 3 != 0) {
+            continue;
+        }
+        runs.push_back({x.a + pad, x.b + pad, x.length - 2 * pad});
+    }
+    return runs;
+}
+
+/* Cut run interiors so that no path that leaves or skips a piece is cheaper
+ * than its matches. Take any path that aligns the nucleotides just before and
+ * at the end of an interior as matches but leaves its diagonal in between.
+ * Since an insertion cannot follow a deletion, it opens both an insertion and
+ * a deletion there, and every other row and column it spends costs at least
+ * the cheapest emission or gap extension. An interior is cut once the matches
+ * along it cost more than that lower bound; the next piece starts 2 * pad
+ * nucleotides later, leaving a segment in between.
+ *
+ * The matches of a piece of L nucleotides then cost less than the opening
+ * plus L - 1 times the highest of those per-row bounds, which is at most
+ * deletion_ext. Skipping the whole piece with gaps costs at least an
+ * insertion and a deletion, L - 1 extensions of each, and L inserted
+ * nucleotides, so it is never cheaper either. Paths that cross the rows of a
+ * piece on another diagonal throughout have no such local bound, since their
+ * cost depends on the sequences around the piece; pieces are instead checked
+ * with a DP around them (see verify_runs), and are at most max_length
+ * nucleotides (a multiple of 3) to keep that DP small. */
+vector<anchor_t> split_runs(const vector<anchor_t>& runs, const string& seq_a,
+                            const score_model_t& model, int pad,
+                            int max_length) {
+    const double opening =
+        model.insertion + model.deletion +
+        *std::min_element(model.nuc_freqs.begin(), model.nuc_freqs.end());
+    const double match = model.no_insertion + model.no_deletion;
+
+    vector<anchor_t> pieces;
+    for(const auto& x : runs) {
+        int start = x.a, end = x.a + x.length;
+        double excess = 0.0, highest = 0.0;
+        for(int i = start; i < end; i++) {
+            const double* e = model.emission_row(i + 1);
+            double low = min(*std::min_element(e, e + 5), model.deletion_ext);
+            excess += e[score_model_t::nuc(seq_a[i])] + match - low;
+            highest = max(highest, low);
+            if(excess + highest < opening && i - start < max_length) continue;
+            // piece up to the last codon that keeps the bound
+            int cut = start + (i - start) / 3 * 3;
+            if(cut > start) {
+                pieces.push_back({start, x.b + start - x.a, cut - start});
+            }
+            start = cut + 2 * pad;
+            i = start - 1;
+            excess = highest = 0.0;
+        }
+        if(end > start) {
+            pieces.push_back({start, x.b + start - x.a, end - start});
+        }
+    }
+    return pieces;
+}
+
+/* Estimated memory of mg94_marginal_runs: the backtracking info of the
+ * largest box checked by verify_runs, i.e. span pieces of at most max_length
+ * nucleotides and the segments around them. Runs are cut into pieces as
+ * split_runs does when only max_length limits them. */
+size_t runs_bytes(const string& seq_a, const string& seq_b, int min_run,
+                  int pad, int max_length, int span) {
+    vector<anchor_t> pieces;
+    for(const auto& x : identity_runs(seq_a, seq_b, min_run, pad)) {
+        for(int d = 0; d < x.length; d += max_length + 2 * pad) {
+            pieces.push_back({x.a + d, x.b + d, min(max_length, x.length - d)});
+        }
+    }
+    pieces.push_back({static_cast<int>(seq_a.length()),
+                      static_cast<int>(seq_b.length()), 0});
+    int count = pieces.size() - 1;
+    size_t bytes = 0;
+    for(int w = 0; w <= max(0, count - span); w++) {
+        int a = w == 0 ? 0 : pieces[w - 1].a + pieces[w - 1].length;
+        int b = w == 0 ? 0 : pieces[w - 1].b + pieces[w - 1].length;
+        const anchor_t& end = pieces[min(w + span, count)];
+        bytes = max(bytes,
+                    (end.a - a + 1) * traceback_t::stride(end.b - b + 1));
+    }
+    return bytes;
+}
+
+/* Check windows of span consecutive runs of chain (the last one ends the
+ * sequences; shorter windows if there are fewer runs) with the DP over the
+ * box between the runs on either side of the window, and clear keep[x] for
+ * every run x that the best path of a box does not follow on its diagonal. A
+ * window is only checked if any of the segments it spans (parts, see
+ * align_segments) is marked in unchecked. Boxes are aligned on up to threads
+ * threads. */
+static int verify_runs(const string& seq_a, const string& seq_b,
+                       const vector<anchor_t>& chain,
+                       const vector<bool>& unchecked, int span,
+                       Matrix64f& P_m, int threads,
+                       const indel_params_t& indel, vector<bool>& keep) {
+    int count = chain.size() - 1;
+    if(count == 0) return 0;
+    int windows = max(0, count - span) + 1;
+    vector<int> status(windows, 0);
+    vector<vector<int>> dropped(windows);
+    parallel_tasks(windows, threads, [&](int w) {
+        int last = min(w + span, count);
+        if(std::none_of(unchecked.begin() + w, unchecked.begin() + last + 1,
+                        [](bool u) { return u; })) {
+            return;
+        }
+        int a = w == 0 ? 0 : chain[w - 1].a + chain[w - 1].length;
+        int b = w == 0 ? 0 : chain[w - 1].b + chain[w - 1].length;
+        alignment_t box;
+        status[w] = mg94_marginal({seq_a.substr(a, chain[last].a - a),
+                                   seq_b.substr(b, chain[last].b - b)},
+                                  box, P_m, indel);
+        if(status[w] != 0) return;
+        // position of seq_b matched with each position of seq_a in the box
+        vector<int> to_b(chain[last].a - a, -1);
+        const string& row_a = box.f.seq_data[0];
+        const string& row_b = box.f.seq_data[1];
+        for(size_t k = 0, i = 0, j = 0; k < row_a.length(); k++) {
+            if(row_a[k] != '-' && row_b[k] != '-') to_b[i] = j;
+            i += row_a[k] != '-';
+            j += row_b[k] != '-';
+        }
+        for(int x = w; x < last; x++) {
+            for(int i = 0; i < chain[x].length; i++) {
+                if(to_b[chain[x].a - a + i] != chain[x].b - b + i) {
+                    dropped[w].push_back(x);
+                    break;
+                }
+            }
+        }
+    });
+    for(int w = 0; w < windows; w++) {
+        if(status[w] != 0) return EXIT_FAILURE;
+        for(int x : dropped[w]) keep[x] = false;
+    }
+    return 0;
+}
+
+/* Marginal MG94 alignment that skips the DP across long exact matches.
+ * Interiors of identity runs (see identity_runs and split_runs) are aligned
+ * as matches and only the segments between them, which overlap each run by
+ * pad nucleotides, are aligned with mg94_marginal on up to threads threads.
+ * The interiors are optimal among alignments that match the nucleotides next
+ * to them or skip them with gaps; a segment must therefore cross the pads of
+ * its runs on their diagonal, or the run is dropped and the segments around it
+ * are aligned again as one. Paths that cross runs on another diagonal are
+ * checked with the DP over the box around each window of span consecutive
+ * runs, which bounds paths that skip up to span runs at once (see
+ * verify_runs); runs off the best path of a box are dropped as well. Once a
+ * run is dropped, the boxes around it span the runs that are kept on either
+ * side, and only the segments and boxes next to it are aligned again. Paths
+ * that skip more than span kept runs at once are not compared with any box.
+ * The weight is that of the whole alignment. */
+int mg94_marginal_runs(vector<string> sequences, alignment_t& aln,
+                       Matrix64f& P_m, int threads,
+                       const indel_params_t& indel) {
+    const int min_run = 60, pad = 12, max_length = 300, span = 2;
+    const string& seq_a = sequences[0];
+    const string& seq_b = sequences[1];
+    int m = seq_a.length();
+    int n = seq_b.length();
+
+    if(check_codon_lengths(sequences) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+    mg94_marginal_p(p, P_m);
+    score_model_t model(seq_a, p, indel);
+    vector<anchor_t> runs =
+        split_runs(identity_runs(seq_a, seq_b, min_run, pad), seq_a, model,
+                   pad, max_length);
+    runs.push_back({m, n, 0});  // end of the last segment
+
+    // segments to align, and segments whose boxes are still to be checked
+    vector<bool> todo(runs.size(), true), unchecked(runs.size(), true);
+    vector<alignment_t> parts;
+    for(;;) {
+        if(align_segments(seq_a, seq_b, runs, todo, parts, P_m, threads,
+                          indel) != 0) {
+            return EXIT_FAILURE;
+        }
+        // pads must be aligned as matches on both sides of each run
+        auto matches = [&](const alignment_t& part, bool tail) {
+            for(const auto& row : part.f.seq_data) {
+                string side = tail ? row.substr(row.length() - pad)
+                                   : row.substr(0, pad);
+                if(side.find('-') != string::npos) return false;
+            }
+            return true;
+        };
+        vector<bool> keep(runs.size(), true);
+        for(size_t s = 0; s + 1 < runs.size(); s++) {
+            keep[s] = matches(parts[s], true) && matches(parts[s + 1], false);
+        }
+        if(std::all_of(keep.begin(), keep.end(), [](bool k) { return k; })) {
+            if(verify_runs(seq_a, seq_b, runs, unchecked, span, P_m, threads,
+                           indel, keep) != 0) {
+                return EXIT_FAILURE;
+            }
+            unchecked.assign(runs.size(), false);
+            if(std::all_of(keep.begin(), keep.end(),
+                           [](bool k) { return k; })) {
+                break;
+            }
+        }
+
+        // segments around dropped runs are joined and aligned again
+        vector<anchor_t> kept;
+        vector<alignment_t> kept_parts;
+        bool join = false, join_unchecked = false;
+        for(size_t s = 0; s < runs.size(); s++) {
+            join_unchecked = join_unchecked || unchecked[s];
+            if(!keep[s]) {
+                join = true;
+                continue;
+            }
+            kept.push_back(runs[s]);
+            kept_parts.push_back(std::move(parts[s]));
+            todo[kept.size() - 1] = join;
+            unchecked[kept.size() - 1] = join || join_unchecked;
+            join = join_unchecked = false;
+        }
+        runs = std::move(kept);
+        parts = std::move(kept_parts);
+        todo.resize(runs.size());
+        unchecked.resize(runs.size());
+    }
+
+    stitch_segments(seq_a, seq_b, runs, parts, aln);
+    aln.weight = alignment_score(aln.f.seq_data, P_m, indel);
+
+    return 0;
+}
+
+TEST_CASE("[anchors.cc] find_anchors") {
+    //              codons:  0  1  2  3  4  5  6  7
+    string seq_a = "ATGCCCAAATTTGGGCCCAAATTTGGGTGA";
+    string seq_b = "ATGCCAAATGGGCCCAAAAATTTGGGTGA";
+
+    vector<anchor_t> anchors = find_anchors(seq_a, seq_b, 6);
+    REQUIRE(!anchors.empty());
+    for(const auto& x : anchors) {
+        CHECK(x.a % 3 == 0);
+        CHECK(x.length % 3 == 0);
+        CHECK(seq_a.substr(x.a, x.length) == seq_b.substr(x.b, x.length));
+    }
+
+    // repeated k-mers of the reference are not used as seeds
+    CHECK(find_anchors("AAAAAAAAAAAA", "AAAAAAAAA", 6).empty());
+    // ambiguous nucleotides break seeds
+    CHECK(find_anchors("ACGTNAGGTACC", "ACGTNAGGTACC", 6).size() == 1);
+}
+
+TEST_CASE("[anchors.cc] chain_anchors") {
+    // the longest collinear chain skips the crossing anchor
+    vector<anchor_t> anchors = {
+        {0, 0, 30}, {30, 60, 12}, {45, 33, 21}, {90, 90, 9}};
+    vector<anchor_t> chain = chain_anchors(anchors, 0);
+    REQUIRE(chain.size() == 3);
+    CHECK(chain[0].a == 0);
+    CHECK(chain[1].a == 45);
+    CHECK(chain[2].a == 90);
+
+    // margins shorten anchors in both sequences
+    chain = chain_anchors({{3, 4, 18}}, 7);
+    REQUIRE(chain.size() == 1);
+    CHECK(chain[0].a == 9);
+    CHECK(chain[0].b == 10);
+    CHECK(chain[0].length == 6);
+    CHECK(chain_anchors({{3, 4, 12}}, 6).empty());
+}
+
+TEST_CASE("[anchors.cc] mg94_marginal_anchored") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+
+    for(string name : {"001", "002", "003"}) {
+        fasta_t f("../../fasta/example-" + name + ".fasta");
+        REQUIRE(read_fasta(f) == 0);
+        alignment_t aln, aln_anchored;
+        REQUIRE(mg94_marginal(f.seq_data, aln, P) == 0);
+        for(int threads : {1, 2}) {
+            aln_anchored = alignment_t();
+            REQUIRE(mg94_marginal_anchored(f.seq_data, aln_anchored, P, 12,
+                                           threads) == 0);
+            // same sequences, weight of the stitched alignment
+            string a = aln_anchored.f.seq_data[0];
+            string b = aln_anchored.f.seq_data[1];
+            a.erase(std::remove(a.begin(), a.end(), '-'), a.end());
+            b.erase(std::remove(b.begin(), b.end(), '-'), b.end());
+            CHECK(a == f.seq_data[0]);
+            CHECK(b == f.seq_data[1]);
+            CHECK(aln_anchored.weight ==
+                  doctest::Approx(alignment_score(aln_anchored.f.seq_data, P)));
+            CHECK(aln_anchored.weight >= aln.weight - 0.001);
+        }
+    }
+
+    SUBCASE("no anchors") {
+        vector<string> seqs = {"CTCTGGATAGTG", "CTATAGTG"};
+        alignment_t aln, aln_anchored;
+        REQUIRE(mg94_marginal(seqs, aln, P) == 0);
+        REQUIRE(mg94_marginal_anchored(seqs, aln_anchored, P) == 0);
+        CHECK(aln_anchored.f.seq_data == aln.f.seq_data);
+        CHECK(aln_anchored.weight == doctest::Approx(aln.weight));
+    }
+    SUBCASE("invalid input") {
+        alignment_t aln;
+        CHECK(mg94_marginal_anchored({"CTCTGGATAGT", "CTATAGTG"}, aln, P) ==
+              EXIT_FAILURE);
+        CHECK(mg94_marginal_anchored({"CTCTGGATAGTG", "CTATAGTG"}, aln, P,
+                                     10) == EXIT_FAILURE);
+    }
+}
+
+TEST_CASE("[anchors.cc] identity_runs") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+    mg94_marginal_p(p, P);
+
+    fasta_t f("../../fasta/example-003.fasta");
+    REQUIRE(read_fasta(f) == 0);
+    string seq_a = f.seq_data[0];
+    // a substitution and a codon deletion
+    string seq_b = seq_a;
+    seq_b[200] = seq_b[200] == 'A' ? 'C' : 'A';
+    seq_b.erase(400, 3);
+
+    vector<anchor_t> runs = identity_runs(seq_a, seq_b, 60, 12);
+    REQUIRE(!runs.empty());
+    for(const auto& x : runs) {
+        CHECK(x.a % 3 == 0);
+        CHECK((x.b - x.a) % 3 == 0);
+        CHECK(x.length >= 36);
+        // interiors and their pads are exact matches
+        CHECK(seq_a.substr(x.a - 12, x.length + 24) ==
+              seq_b.substr(x.b - 12, x.length + 24));
+    }
+
+    // default gap costs leave short runs whole
+    score_model_t model(seq_a, p);
+    vector<anchor_t> pieces = split_runs(runs, seq_a, model, 12, seq_a.size());
+    REQUIRE(pieces.size() == runs.size());
+    for(size_t x = 0; x < runs.size(); x++) {
+        CHECK(pieces[x].a == runs[x].a);
+        CHECK(pieces[x].length == runs[x].length);
+    }
+    // long runs are cut into pieces of at most max_length nucleotides
+    pieces = split_runs(runs, seq_a, model, 12, 60);
+    CHECK(pieces.size() > runs.size());
+    for(const auto& x : pieces) {
+        CHECK(x.length <= 60);
+        CHECK(x.length % 3 == 0);
+    }
+
+    // cheap gaps bound the matches that can be skipped
+    indel_params_t indel;
+    indel.insertion = indel.deletion = 0.3;
+    score_model_t gappy(seq_a, p, indel);
+    pieces = split_runs(runs, seq_a, gappy, 12);
+    CHECK(pieces.size() > runs.size());
+    for(size_t x = 0; x + 1 < pieces.size(); x++) {
+        CHECK(pieces[x].length % 3 == 0);
+        CHECK(pieces[x + 1].a - pieces[x].a - pieces[x].length >= 24);
+    }
+
+    // skipping a piece with gaps costs more than its matches
+    for(const score_model_t* m : {&model, &gappy}) {
+        double freq = *std::min_element(m->nuc_freqs.begin(),
+                                        m->nuc_freqs.end());
+        for(const auto& x : split_runs(runs, seq_a, *m, 12)) {
+            double matches = 0.0;
+            for(int i = x.a; i < x.a + x.length; i++) {
+                matches += m->emission(i + 1, seq_a[i]) + m->no_insertion +
+                           m->no_deletion;
+            }
+            double skip =
+                m->insertion + m->deletion +
+                (x.length - 1) * (m->insertion_ext + m->deletion_ext) +
+                x.length * freq;
+            CHECK(matches < skip);
+        }
+    }
+}
+
+TEST_CASE("[anchors.cc] mg94_marginal_runs") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+
+    for(string name : {"001", "002", "003"}) {
+        fasta_t f("../../fasta/example-" + name + ".fasta");
+        REQUIRE(read_fasta(f) == 0);
+        alignment_t aln, aln_runs;
+        REQUIRE(mg94_marginal(f.seq_data, aln, P) == 0);
+        REQUIRE(mg94_marginal_runs(f.seq_data, aln_runs, P) == 0);
+        CHECK(aln_runs.f.seq_data == aln.f.seq_data);
+        CHECK(aln_runs.weight ==
+              doctest::Approx(alignment_score(aln.f.seq_data, P)));
+    }
+
+    SUBCASE("nearly identical") {
+        fasta_t f("../../fasta/example-10k.fasta");
+        REQUIRE(read_fasta(f) == 0);
+        string seq_a = f.seq_data[0].substr(0, 3000);
+        // substitutions, codon indels, and a pair of frameshifts
+        string seq_b = seq_a;
+        for(size_t i = 50; i < seq_b.length(); i += 97) {
+            seq_b[i] = seq_b[i] == 'A' ? 'G' : 'A';
+        }
+        seq_b.erase(1000, 3);
+        seq_b.insert(2000, "GGC");
+        seq_b.erase(2400, 1);
+        seq_b.insert(2410, "T");
+        vector<string> seqs = {seq_a, seq_b};
+        REQUIRE(identity_runs(seq_a, seq_b).size() > 10);
+
+        alignment_t aln;
+        REQUIRE(mg94_marginal(seqs, aln, P) == 0);
+        for(int threads : {1, 2}) {
+            alignment_t aln_runs;
+            REQUIRE(mg94_marginal_runs(seqs, aln_runs, P, threads) == 0);
+            CHECK(aln_runs.f.seq_data == aln.f.seq_data);
+            CHECK(aln_runs.weight ==
+                  doctest::Approx(alignment_score(aln.f.seq_data, P)));
+        }
+    }
+
+    SUBCASE("run off the best path") {
+        fasta_t f("../../fasta/example-10k.fasta");
+        REQUIRE(read_fasta(f) == 0);
+        // the run r is on the anchor chain, but matching the diverged copy of
+        // y costs less than the gaps around r
+        string x = f.seq_data[0].substr(0, 300);
+        string r = f.seq_data[0].substr(300, 63);
+        string y = f.seq_data[0].substr(363, 300);
+        string z = f.seq_data[0].substr(663, 150);
+        string y_b = y;
+        for(size_t i = 10; i < y_b.length(); i += 20) {
+            y_b[i] = y_b[i] == 'A' ? 'C' : 'A';
+        }
+        vector<string> seqs = {x + r + y + z, x + y_b + r + z};
+        REQUIRE(identity_runs(seqs[0], seqs[1]).size() == 3);
+
+        alignment_t aln, aln_runs;
+        REQUIRE(mg94_marginal(seqs, aln, P) == 0);
+        REQUIRE(mg94_marginal_runs(seqs, aln_runs, P) == 0);
+        CHECK(aln_runs.f.seq_data == aln.f.seq_data);
+    }
+
+    SUBCASE("path skipping two runs") {
+        fasta_t f("../../fasta/example-10k.fasta");
+        REQUIRE(read_fasta(f) == 0);
+        // runs r and t are each on the best path of the box between their
+        // neighbours, but matching the diverged copy of y skips both
+        string x = f.seq_data[0].substr(0, 300);
+        string r = f.seq_data[0].substr(300, 63);
+        string s = f.seq_data[0].substr(363, 30);
+        string t = f.seq_data[0].substr(393, 63);
+        string y = f.seq_data[0].substr(456, 300);
+        string z = f.seq_data[0].substr(756, 150);
+        string s_b = s, y_b = y;
+        for(size_t i = 1; i < s_b.length(); i += 6) {
+            s_b[i] = s_b[i] == 'A' ? 'C' : 'A';
+        }
+        for(size_t i = 10; i < y_b.length(); i += 20) {
+            y_b[i] = y_b[i] == 'A' ? 'C' : 'A';
+        }
+        vector<string> seqs = {x + r + s + t + y + z,
+                               x + y_b + r + s_b + t + z};
+        REQUIRE(identity_runs(seqs[0], seqs[1]).size() == 4);
+
+        alignment_t aln, aln_runs;
+        REQUIRE(mg94_marginal(seqs, aln, P) == 0);
+        REQUIRE(mg94_marginal_runs(seqs, aln_runs, P) == 0);
+        CHECK(aln_runs.f.seq_data == aln.f.seq_data);
+    }
+}
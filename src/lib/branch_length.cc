@@ -0,0 +1,230 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#include <doctest/doctest.h>
+
+#include <coati/branch_length.hpp>
+
+/* Bounds of estimated branch lengths */
+const double min_branch_length = 1e-6;
+const double max_branch_length = 10.0;
+/* Relative change of the branch length that triggers a new alignment */
+const double realign_tolerance = 0.01;
+
+/* Cost (-log) of the emissions (aligned nucleotides) of a pairwise
+ * alignment under P(t), and its first and second derivatives with respect to
+ * t. Gap costs do not depend on t and are left out. */
+void emission_cost(const vector<string>& alignment, const p_engine_t& engine,
+                   double t, double& f, double& df, double& d2f) {
+    // number of times each reference codon, codon position, and nucleotide
+    // (A, C, G, T, N) are aligned
+    Eigen::Tensor<double, 3> counts(64, 3, 5);
+    counts.setZero();
+    // aligned nucleotides of ambiguous reference codons, whose emissions are
+    // averaged over the compatible codons (see transition)
+    struct ambiguous_t {
+        vector<int> codons;
+        int pos, nuc;
+    };
+    vector<ambiguous_t> ambiguous;
+    string ref = alignment[0];
+    boost::erase_all(ref, "-");
+    int r = 0;  // reference position
+    for(size_t k = 0; k < alignment[0].length(); k++) {
+        if(alignment[0][k] == '-') continue;
+        if(alignment[1][k] != '-') {
+            vector<int> codons = compatible_codons(ref.substr((r / 3) * 3, 3));
+            int nuc = score_model_t::nuc(alignment[1][k]);
+            if(codons.size() == 1) {
+                counts(codons[0], r % 3, nuc) += 1;
+            } else {
+                ambiguous.push_back({codons, r % 3, nuc});
+            }
+        }
+        r++;
+    }
+
+    Matrix64f P, dP, d2P;
+    engine.p(t, P);
+    engine.derivatives(t, dP, d2P);
+    Eigen::Tensor<double, 3> p(64, 3, 4), dp(64, 3, 4), d2p(64, 3, 4);
+    mg94_marginal_p(p, P);
+    mg94_marginal_p(dp, dP);
+    mg94_marginal_p(d2p, d2P);
+
+    f = df = d2f = 0.0;
+    // add c emissions of nuc at codon position pos of the average of codons
+    auto add = [&](const vector<int>& codons, int pos, int nuc, double c) {
+        double m = 0, dm = 0, d2m = 0;
+        for(int cod : codons) {
+            if(nuc < 4) {
+                m += p(cod, pos, nuc);
+                dm += dp(cod, pos, nuc);
+                d2m += d2p(cod, pos, nuc);
+            } else {  // N: average over nucleotides (see transition)
+                for(int b = 0; b < 4; b++) {
+                    m += p(cod, pos, b) / 4.0;
+                    dm += dp(cod, pos, b) / 4.0;
+                    d2m += d2p(cod, pos, b) / 4.0;
+                }
+            }
+        }
+        double size = static_cast<double>(codons.size());
+        m /= size;
+        dm /= size;
+        d2m /= size;
+        f -= c * log(m);
+        df -= c * dm / m;
+        d2f += c * ((dm / m) * (dm / m) - d2m / m);
+    };
+    for(int cod = 0; cod < 64; cod++) {
+        for(int pos = 0; pos < 3; pos++) {
+            for(int nuc = 0; nuc < 5; nuc++) {
+                double c = counts(cod, pos, nuc);
+                if(c == 0) continue;
+                add({cod}, pos, nuc, c);
+            }
+        }
+    }
+    for(const auto& a : ambiguous) {
+        add(a.codons, a.pos, a.nuc, 1.0);
+    }
+}
+
+/* Branch length that minimizes the emission cost of a fixed alignment, by
+ * Newton steps from t. Steps are limited to a factor of 4, and where the cost
+ * is not convex t moves by that factor downhill. */
+double branch_length_newton(const vector<string>& alignment,
+                            const p_engine_t& engine, double t) {
+    double f, df, d2f;
+    for(int it = 0; it < 100; it++) {
+        emission_cost(alignment, engine, t, f, df, d2f);
+        double next = d2f > 0 ? t - df / d2f : (df > 0 ? t / 4 : 4 * t);
+        next = min(max(next, t / 4), 4 * t);
+        next = min(max(next, min_branch_length), max_branch_length);
+        if(fabs(next - t) < 1e-9 * t) return next;
+        t = next;
+    }
+    return t;
+}
+
+/* Maximum-likelihood branch length of a pair, starting from t. Alignment
+ * (mg94_marginal) and optimization of t given the alignment
+ * (branch_length_newton) alternate until t moves by less than 1% or the
+ * alignment does not change. Re-alignments are banded around the previous
+ * path. On return t holds the estimate and aln the last alignment. */
+int estimate_branch_length(vector<string> sequences, alignment_t& aln,
+                           const p_engine_t& engine, double& t,
+                           const indel_params_t& indel) {
+    Matrix64f P;
+    engine.p(t, P);
+    alignment_t next = aln;
+    if(mg94_marginal(sequences, next, P, indel) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    for(int it = 0; it < 20; it++) {
+        double t_next = branch_length_newton(next.f.seq_data, engine, t);
+        bool realign = fabs(t_next - t) > realign_tolerance * t;
+        t = t_next;
+        if(!realign) break;
+
+        engine.p(t, P);
+        band_t band = alignment_band(next, 16);
+        alignment_t banded = aln;
+        if(mg94_marginal_banded(sequences, banded, P, band, -1, 0, indel) !=
+           0) {
+            return EXIT_FAILURE;
+        }
+        bool same = banded.f.seq_data == next.f.seq_data;
+        next = banded;
+        if(same) break;
+    }
+
+    aln = next;
+    return 0;
+}
+
+TEST_CASE("[branch_length.cc] branch_length_newton") {
+    Matrix64f Q;
+    mg94_q(Q);
+    p_engine_t engine(Q);
+
+    vector<string> alignment = {
+        "ATGCCCAAATTTGGGCCCAAATTTGGGTGAACGTTAAGGCCTGCA",
+        "ATGCCTAAATTCGGGCCAAAATTTGGATGAACGTCAAGG-TTGCA"};
+
+    double t = branch_length_newton(alignment, engine, 0.0133);
+    double f, df, d2f, f_lo, f_hi;
+    emission_cost(alignment, engine, t, f, df, d2f);
+    CHECK(fabs(df) < 1e-6);
+    CHECK(d2f > 0);
+    emission_cost(alignment, engine, t * 0.99, f_lo, df, d2f);
+    emission_cost(alignment, engine, t * 1.01, f_hi, df, d2f);
+    CHECK(f < f_lo);
+    CHECK(f < f_hi);
+
+    // same estimate from either side
+    CHECK(branch_length_newton(alignment, engine, 1.0) ==
+          doctest::Approx(t).epsilon(1e-6));
+
+    // identical sequences: lower bound
+    vector<string> identical = {"CTCTGGATAGTG", "CTCTGGATAGTG"};
+    CHECK(branch_length_newton(identical, engine, 0.0133) ==
+          doctest::Approx(min_branch_length));
+
+    // ambiguous reference codons cost as in the emission table
+    vector<string> ambiguous = {"CTNTGGATRGTG", "CTATGGAT-GTN"};
+    emission_cost(ambiguous, engine, 0.0133, f, df, d2f);
+    score_model_t model(ambiguous[0], engine.marginal_p(0.0133));
+    double cost = 0.0;
+    for(int i = 1; i < 13; i++) {
+        if(ambiguous[1][i - 1] != '-') {
+            cost += model.emission(i, ambiguous[1][i - 1]);
+        }
+    }
+    CHECK(f == doctest::Approx(cost));
+}
+
+TEST_CASE("[branch_length.cc] estimate_branch_length") {
+    Matrix64f Q;
+    mg94_q(Q);
+    p_engine_t engine(Q);
+
+    vector<string> seqs = {"ATGCCCAAATTTGGGCCCAAATTTGGGTGAACGTTAAGGCCTGCA",
+                           "ATGCCTAAATTCGGGCCAAAATTTGGATGAACGTCAAGGTTGCA"};
+    alignment_t aln;
+    double t = 0.0133;
+    REQUIRE(estimate_branch_length(seqs, aln, engine, t) == 0);
+    CHECK(t > 0.1);
+
+    // t is the optimum for the returned alignment, within tolerance
+    double t_aln = branch_length_newton(aln.f.seq_data, engine, t);
+    CHECK(t_aln == doctest::Approx(t).epsilon(0.01));
+
+    // returned alignment is the best one at its branch length
+    Matrix64f P;
+    alignment_t aln_full;
+    engine.p(t, P);
+    REQUIRE(mg94_marginal(seqs, aln_full, P) == 0);
+    CHECK(aln_full.f.seq_data == aln.f.seq_data);
+}
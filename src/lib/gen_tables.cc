@@ -0,0 +1,70 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+/* Build-time generator of mg94_tables.cc, the default model tables used by
+ * mg94_p and mg94_marginal_p. Values are written as hexadecimal floating point
+ * literals, so that the tables are identical to computing them at run time. */
+
+#include <coati/mutation_coati.hpp>
+#include <cstdio>
+
+// empty tables, so that mg94_p and mg94_marginal_p compute the model
+const double mg94_default_brlen = 0.0;
+const double mg94_default_P[64 * 64] = {};
+const double mg94_default_p[64 * 3 * 4] = {};
+
+namespace {
+// default branch length of coati alignpair (--evo-time)
+constexpr double default_brlen = 0.0133;
+
+void write_table(FILE* out, const char* name, const double* x, int size) {
+    fprintf(out, "const double %s[%d] = {", name, size);
+    for(int k = 0; k < size; k++) {
+        fprintf(out, "%s%a,", k % 4 == 0 ? "\n    " : " ", x[k]);
+    }
+    fprintf(out, "\n};\n");
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if(argc != 2) {
+        fprintf(stderr, "Usage: %s mg94_tables.cc\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Matrix64f P;
+    mg94_p(P, default_brlen);
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+    mg94_marginal_p(p, P);
+
+    FILE* out = fopen(argv[1], "w");
+    if(out == nullptr) {
+        fprintf(stderr, "Cannot open %s. Exiting!\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    fprintf(out, "// Generated by coati-gen-tables. Do not edit.\n\n");
+    fprintf(out, "#include <coati/mutation_coati.hpp>\n\n");
+    fprintf(out, "const double mg94_default_brlen = %a;\n", default_brlen);
+    write_table(out, "mg94_default_P", P.data(), P.size());
+    write_table(out, "mg94_default_p", p.data(), p.size());
+    return fclose(out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
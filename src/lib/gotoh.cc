@@ -22,10 +22,557 @@
 
 #include <doctest/doctest.h>
 
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <array>
 #include <coati/gotoh.hpp>
+#include <coati/isa.hpp>
+#include <cstring>
+#include <random>
+#include <unordered_map>
+
+namespace {
+// vectors per step of the batch kernel, which are independent of each other so
+// that their latencies overlap
+constexpr int batch_vectors = 2;
+// doubles per vector of the widest kernel
+constexpr int max_lanes = 8;
+
+/* Vectors (GCC/Clang vector extensions) of W doubles, floats, and int64
+ * masks, for kernels with W doubles per vector register (see isa.hpp) */
+template <int W>
+struct simd {
+    typedef double d __attribute__((vector_size(8 * W)));
+    typedef float f __attribute__((vector_size(4 * W)));
+    typedef int64_t i __attribute__((vector_size(8 * W)));
+};
+#define COATI_SIMD inline __attribute__((always_inline))
+
+template <class V, class T>
+COATI_SIMD V simd_load(const T* x) {
+    V v;
+    std::memcpy(&v, x, sizeof(v));
+    return v;
+}
+template <class V, class T>
+COATI_SIMD void simd_store(T* x, V v) {
+    std::memcpy(x, &v, sizeof(v));
+}
+template <class V, class T>
+COATI_SIMD V simd_set(T x) {
+    return V{} + x;
+}
+// lanes of a where mask is set, lanes of b otherwise
+template <class M, class V>
+COATI_SIMD V simd_select(M mask, V a, V b) {
+    return (V)(((M)a & mask) | ((M)b & ~mask));
+}
+// same as std::min(a, b) per lane
+template <class V>
+COATI_SIMD V simd_min(V a, V b) {
+    return simd_select(b < a, b, a);
+}
+// round to float precision, as stored in DP matrices
+template <int W>
+COATI_SIMD typename simd<W>::d simd_float(typename simd<W>::d a) {
+    return __builtin_convertvector(
+        __builtin_convertvector(a, typename simd<W>::f), typename simd<W>::d);
+}
+
+struct diagonal_dp_t;
+struct lanes_row_t;
+
+/* Vector kernels built for one instruction set (see simd_kernels) */
+struct simd_kernels_t {
+    int lanes;  // doubles per vector
+    void (*diagonal_step)(diagonal_dp_t& dp, int d, int lo, int hi);
+    void (*lanes_row)(const score_model_t& model, int L, lanes_row_t& cur,
+                      const lanes_row_t& prev, const double* freq_b,
+                      const double* em, double* bp, double* bq);
+};
+const simd_kernels_t& simd_kernels();
+
+/* Anti-diagonal fill of the marginal MG94 DP (cells with constant i + j),
+ * whose cells are independent of each other. Only three anti-diagonals of D,
+ * P, and Q are kept and emissions are looked up in a table per reference
+ * position and nucleotide. */
+struct diagonal_dp_t {
+    // anti-diagonals d - 2 (0), d - 1 (1), and d (2) indexed by row. Values
+    // of step() are rounded to float and Bd is stored as 0.0, 1.0, or 2.0.
+    struct diag_t {
+        vector<double> D, P, Q, Bd;
+    };
+    static constexpr int pad = max_lanes;  // room for the last chunk
+
+    diagonal_dp_t(const string& seq_a, const string& seq_b,
+                  const score_model_t& model, traceback_t& B);
+    // rows lo..hi of anti-diagonal d (clipped to the matrix), and its cells
+    // on the first row and column
+    void step(int d, int lo = 1, int hi = numeric_limits<int>::max()) {
+        kernels.diagonal_step(*this, d, lo, hi);
+    }
+    template <int W>
+    COATI_SIMD void step_lanes(int d, int lo, int hi);
+    float weight() const { return static_cast<float>(diag[2].D[m]); }
+    // mark row i of the last anti-diagonal as unreachable
+    void clear(int i) {
+        diag[2].D[i] = diag[2].P[i] = diag[2].Q[i] =
+            std::numeric_limits<float>::max();
+        diag[2].Bd[i] = -1.0;
+    }
+
+    const simd_kernels_t& kernels;
+    const score_model_t& model;
+    traceback_t& B;
+    int m, n;
+    // nucleotides of seq_b and their frequencies in reverse order, so that
+    // cells (i, d - i) of an anti-diagonal read consecutive elements
+    vector<int> nuc_b;
+    vector<double> freq_b;
+    dp_line_t top, left;
+    array<diag_t, 3> diag;
+    vector<double> em, bp, bq;
+};
+
+diagonal_dp_t::diagonal_dp_t(const string& seq_a, const string& seq_b,
+                             const score_model_t& model, traceback_t& B)
+    : kernels{simd_kernels()},
+      model{model},
+      B{B},
+      m{static_cast<int>(seq_a.length())},
+      n{static_cast<int>(seq_b.length())},
+      nuc_b(n + 1 + pad, 4),
+      freq_b(n + 1 + pad, 0.0) {
+    for(int j = 1; j < n + 1; j++) {
+        nuc_b[n - j] = score_model_t::nuc(seq_b[j - 1]);
+        freq_b[n - j] = model.nuc_freq(seq_b[j - 1]);
+    }
+
+    mg94_marginal_border(seq_a, seq_b, model, top, left);
+
+    // first row and column of backtracking info
+    uint8_t* row = B.row(0);
+    row[0] = traceback_t::pack(0, -1, -1);
+    for(int j = 1; j < n + 1; j++) {
+        row[j] = traceback_t::pack(1, j == 1 ? 2 : 1, -1);
+    }
+    for(int i = 1; i < m + 1; i++) {
+        *B.cell(i, 0) = traceback_t::pack(2, -1, i == 1 ? 2 : 1);
+    }
+
+    double max_f = std::numeric_limits<float>::max();
+    size_t size = m + 1 + pad;
+    for(auto& a : diag) {
+        a = {vector<double>(size, max_f), vector<double>(size, max_f),
+             vector<double>(size, max_f), vector<double>(size, -1.0)};
+    }
+    em.resize(size);
+    bp.resize(size);
+    bq.resize(size);
+    diag[2].D[0] = 0.0;  // anti-diagonal 0
+    diag[2].Bd[0] = 0.0;
+}
+
+/* Fill rows lo..hi of anti-diagonal d, W cells at a time, selecting the three
+ * states without branches. Cells after hi, up to the end of the last chunk,
+ * are overwritten. Operations and comparisons are the same as in
+ * frameshift_fill_block, giving identical weights and backtracking info. */
+template <int W>
+COATI_SIMD void diagonal_dp_t::step_lanes(int d, int lo, int hi) {
+    typedef typename simd<W>::d simd_d;
+    typedef typename simd<W>::i simd_i;
+
+    // gap costs, as scalars for vector arithmetic
+    const double insertion = model.insertion, deletion = model.deletion;
+    const double insertion_ext = model.insertion_ext;
+    const double deletion_ext = model.deletion_ext;
+    const double no_insertion = model.no_insertion;
+    const double no_deletion = model.no_deletion;
+    const double no_insertion_ext = model.no_insertion_ext;
+    const double no_deletion_ext = model.no_deletion_ext;
+
+    const simd_d one = simd_set<simd_d>(1.0), two = simd_set<simd_d>(2.0);
+    const simd_d zero = simd_set<simd_d>(0.0);
+    const simd_d max_d = simd_set<simd_d>(numeric_limits<double>::max());
+
+    std::rotate(diag.begin(), diag.begin() + 1, diag.end());
+    const diag_t& d2 = diag[0];
+    const diag_t& d1 = diag[1];
+    diag_t& cur = diag[2];
+
+    lo = max(lo, max(1, d - n));
+    hi = min(hi, min(m, d - 1));
+    for(int i = lo; i < hi + 1; i++) {
+        em[i] = model.emission_row(i)[nuc_b[n - d + i]];
+    }
+
+    for(int i = lo; i < hi + 1; i += W) {
+        simd_d freq = simd_load<simd_d>(&freq_b[n - d + i]);
+
+        // insertion, from cell (i, j - 1)
+        simd_d D1 = simd_load<simd_d>(&d1.D[i]);
+        simd_d B1 = simd_load<simd_d>(&d1.Bd[i]);
+        simd_d p1 = simd_load<simd_d>(&d1.P[i]) + insertion_ext + freq;
+        simd_d p2 = simd_select(
+            B1 == zero, D1 + insertion + freq + no_insertion_ext,
+            simd_select(B1 == one, D1 + insertion_ext + freq, max_d));
+        simd_d pf = simd_float<W>(simd_min(p1, p2));
+        simd_store(&bp[i], simd_select(p1 < p2, one, two));
+
+        // deletion, from cell (i - 1, j)
+        simd_d U1 = simd_load<simd_d>(&d1.D[i - 1]);
+        simd_d C1 = simd_load<simd_d>(&d1.Bd[i - 1]);
+        simd_d q1 = simd_load<simd_d>(&d1.Q[i - 1]) + deletion_ext;
+        simd_d q2 = simd_select(
+            C1 == zero, U1 + no_insertion + deletion + no_deletion_ext,
+            simd_select(C1 == one, U1 + no_deletion_ext + deletion,
+                        U1 + deletion_ext));
+        simd_d qf = simd_float<W>(simd_min(q1, q2));
+        simd_store(&bq[i], simd_select(q1 < q2, one, two));
+
+        // match/mismatch, from cell (i - 1, j - 1)
+        simd_d e = simd_load<simd_d>(&em[i]);
+        simd_d D2 = simd_load<simd_d>(&d2.D[i - 1]);
+        simd_d B2 = simd_load<simd_d>(&d2.Bd[i - 1]);
+        simd_d dm = simd_select(
+            B2 == zero, D2 + no_insertion + no_deletion + e,
+            simd_select(B2 == one, D2 + no_deletion + e, D2 + e));
+
+        // lowest (-log(weight)) value between the three events
+        simd_i use_d = (dm < pf) & (dm < qf);
+        simd_i use_p = ~(dm < pf) & (pf < qf);
+        simd_store(&cur.P[i], pf);
+        simd_store(&cur.Q[i], qf);
+        simd_store(&cur.D[i], simd_select(use_d, simd_float<W>(dm),
+                                          simd_select(use_p, pf, qf)));
+        simd_store(&cur.Bd[i],
+                   simd_select(use_d, zero, simd_select(use_p, one, two)));
+    }
+
+    // first row and column (after the last chunk, which may overrun)
+    if(d < n + 1) {
+        cur.D[0] = top.D(d);
+        cur.P[0] = top.P(d);
+        cur.Q[0] = top.Q(d);
+        cur.Bd[0] = top.Bd(d);
+    }
+    if(d < m + 1) {
+        cur.D[d] = left.D(d);
+        cur.P[d] = left.P(d);
+        cur.Q[d] = left.Q(d);
+        cur.Bd[d] = left.Bd(d);
+    }
+
+    for(int i = lo; i < hi + 1; i++) {
+        *B.cell(i, d - i) =
+            traceback_t::pack(static_cast<int>(cur.Bd[i]),
+                              static_cast<int>(bp[i]), static_cast<int>(bq[i]));
+    }
+}
+
+/* Rows i - 1 and i of the DP of the batch kernel (see mg94_marginal_lanes).
+ * Values are rounded to float and Bd is stored as 0.0, 1.0, or 2.0. */
+struct lanes_row_t {
+    vector<double> D, P, Q, Bd;
+};
+
+/* Fill row i of the batch kernel, columns j > 0 of all L lanes, W lanes at a
+ * time. Element [j * L + l] belongs to lane l. */
+template <int W>
+COATI_SIMD void lanes_row(const score_model_t& model, int L, lanes_row_t& cur,
+                          const lanes_row_t& prev, const double* freq_b,
+                          const double* em, double* bp, double* bq) {
+    typedef typename simd<W>::d simd_d;
+    typedef typename simd<W>::i simd_i;
+
+    // gap costs (shared by all lanes), as scalars for vector arithmetic
+    const double insertion = model.insertion, deletion = model.deletion;
+    const double insertion_ext = model.insertion_ext;
+    const double deletion_ext = model.deletion_ext;
+    const double no_insertion = model.no_insertion;
+    const double no_deletion = model.no_deletion;
+    const double no_insertion_ext = model.no_insertion_ext;
+    const double no_deletion_ext = model.no_deletion_ext;
+
+    const simd_d one = simd_set<simd_d>(1.0), two = simd_set<simd_d>(2.0);
+    const simd_d zero = simd_set<simd_d>(0.0);
+    const simd_d max_d = simd_set<simd_d>(numeric_limits<double>::max());
+
+    // vectors of consecutive lanes; each one depends on the vector L lanes
+    // back (column j - 1), not on the one just before
+    for(size_t x = L; x < cur.D.size(); x += W) {
+        size_t y = x - L;
+        simd_d freq = simd_load<simd_d>(&freq_b[x]);
+
+        // insertion, from cell (i, j - 1)
+        simd_d D1 = simd_load<simd_d>(&cur.D[y]);
+        simd_d B1 = simd_load<simd_d>(&cur.Bd[y]);
+        simd_d p1 = simd_load<simd_d>(&cur.P[y]) + insertion_ext + freq;
+        simd_d p2 = simd_select(
+            B1 == zero, D1 + insertion + freq + no_insertion_ext,
+            simd_select(B1 == one, D1 + insertion_ext + freq, max_d));
+        simd_d pf = simd_float<W>(simd_min(p1, p2));
+        simd_store(&bp[x], simd_select(p1 < p2, one, two));
+
+        // deletion, from cell (i - 1, j)
+        simd_d U1 = simd_load<simd_d>(&prev.D[x]);
+        simd_d C1 = simd_load<simd_d>(&prev.Bd[x]);
+        simd_d q1 = simd_load<simd_d>(&prev.Q[x]) + deletion_ext;
+        simd_d q2 = simd_select(
+            C1 == zero, U1 + no_insertion + deletion + no_deletion_ext,
+            simd_select(C1 == one, U1 + no_deletion_ext + deletion,
+                        U1 + deletion_ext));
+        simd_d qf = simd_float<W>(simd_min(q1, q2));
+        simd_store(&bq[x], simd_select(q1 < q2, one, two));
+
+        // match/mismatch, from cell (i - 1, j - 1)
+        simd_d e = simd_load<simd_d>(&em[x]);
+        simd_d D2 = simd_load<simd_d>(&prev.D[y]);
+        simd_d B2 = simd_load<simd_d>(&prev.Bd[y]);
+        simd_d dm = simd_select(
+            B2 == zero, D2 + no_insertion + no_deletion + e,
+            simd_select(B2 == one, D2 + no_deletion + e, D2 + e));
+
+        // lowest (-log(weight)) value between the three events
+        simd_i use_d = (dm < pf) & (dm < qf);
+        simd_i use_p = ~(dm < pf) & (pf < qf);
+        simd_store(&cur.P[x], pf);
+        simd_store(&cur.Q[x], qf);
+        simd_store(&cur.D[x], simd_select(use_d, simd_float<W>(dm),
+                                          simd_select(use_p, pf, qf)));
+        simd_store(&cur.Bd[x],
+                   simd_select(use_d, zero, simd_select(use_p, one, two)));
+    }
+}
+
+/* Kernels with W doubles per vector, compiled for the instruction set of the
+ * function they are inlined into */
+template <int W>
+struct simd_lanes_t {
+    COATI_SIMD static void diagonal_step(diagonal_dp_t& dp, int d, int lo,
+                                         int hi) {
+        dp.step_lanes<W>(d, lo, hi);
+    }
+    COATI_SIMD static void lanes_row(const score_model_t& model, int L,
+                                     lanes_row_t& cur, const lanes_row_t& prev,
+                                     const double* freq_b, const double* em,
+                                     double* bp, double* bq) {
+        ::lanes_row<W>(model, L, cur, prev, freq_b, em, bp, bq);
+    }
+};
+
+// entry points of the kernels for each instruction set
+#if defined(__x86_64__) || defined(__i386__)
+#define COATI_TARGET(isa) __attribute__((target(isa)))
+#else
+#define COATI_TARGET(isa)
+#endif
+#define COATI_KERNELS(name, isa, W)                                           \
+    COATI_TARGET(isa)                                                         \
+    void name##_diagonal_step(diagonal_dp_t& dp, int d, int lo, int hi) {     \
+        simd_lanes_t<W>::diagonal_step(dp, d, lo, hi);                        \
+    }                                                                         \
+    COATI_TARGET(isa)                                                         \
+    void name##_lanes_row(const score_model_t& model, int L, lanes_row_t& cur, \
+                          const lanes_row_t& prev, const double* freq_b,      \
+                          const double* em, double* bp, double* bq) {         \
+        simd_lanes_t<W>::lanes_row(model, L, cur, prev, freq_b, em, bp, bq);  \
+    }
+COATI_KERNELS(sse2, "sse2", 2)
+#if defined(__x86_64__) || defined(__i386__)
+COATI_KERNELS(avx2, "avx2", 4)
+COATI_KERNELS(avx512, "avx512f", 8)
+#endif
+#undef COATI_KERNELS
+
+/* Kernels of the instruction set in use (see active_isa) */
+const simd_kernels_t& simd_kernels() {
+    static const simd_kernels_t sse2 = {2, sse2_diagonal_step, sse2_lanes_row};
+#if defined(__x86_64__) || defined(__i386__)
+    static const simd_kernels_t avx2 = {4, avx2_diagonal_step, avx2_lanes_row};
+    static const simd_kernels_t avx512 = {8, avx512_diagonal_step,
+                                          avx512_lanes_row};
+    switch(active_isa()) {
+    case isa_t::avx512:
+        return avx512;
+    case isa_t::avx2:
+        return avx2;
+    default:
+        break;
+    }
+#endif
+    return sse2;
+}
+
+// pairs aligned at once by mg94_marginal_lanes
+int batch_lanes() { return simd_kernels().lanes * batch_vectors; }
+
+}  // namespace
+
+/* Fill the marginal MG94 DP along anti-diagonals, as many cells at a time as
+ * doubles fit in a vector register of the active instruction set (see
+ * isa.hpp). Returns the weight of the alignment and stores backtracking info in
+ * B. */
+float mg94_marginal_diagonal(const string& seq_a, const string& seq_b,
+                             const score_model_t& model, traceback_t& B) {
+    diagonal_dp_t dp(seq_a, seq_b, model, B);
+    for(int d = 1; d < dp.m + dp.n + 1; d++) {
+        dp.step(d);
+    }
+    return dp.weight();
+}
+
+/* Fill the marginal MG94 DP along anti-diagonals with an X-drop rule. Only a
+ * range of rows of each anti-diagonal is live; after it is filled, rows at
+ * either end whose cost exceeds the lowest of the anti-diagonal by more than
+ * x_drop (nats) are dropped, and the next anti-diagonal is filled from the
+ * remaining rows plus one row below them. Costs are compared after adding a
+ * lower bound of the gap that a cell still needs to reach cell (m, n), as
+ * deletions emit no nucleotide and would otherwise look cheapest. Once the
+ * range holds only the last row or column of the matrix, the rest of the
+ * alignment is a forced gap and each anti-diagonal fills a single cell.
+ *
+ * Cells are also scored against emitting the query as unrelated sequence
+ * (the nucleotide frequencies of its prefix minus the cost of the cell), which
+ * grows along homologous stretches and falls elsewhere. Once the highest
+ * score of 60 anti-diagonals in a row is more than x_drop below the highest
+ * so far, so that a short diverged stretch does not end the alignment, the
+ * fill stops and the alignment ends with the best cell reached followed by
+ * the rest of the query inserted and the rest of the reference deleted. The
+ * number of cells filled (of m * n) is stored in cells (if not null). Returns
+ * the weight of the alignment and stores backtracking info in B; cells that
+ * were not filled are not written. */
+float mg94_marginal_xdrop_diagonal(const string& seq_a, const string& seq_b,
+                                   const score_model_t& model, traceback_t& B,
+                                   double x_drop, size_t* cells) {
+    diagonal_dp_t dp(seq_a, seq_b, model, B);
+    const int m = dp.m, n = dp.n;
+
+    // least cost of a deleted and an inserted nucleotide
+    const double deleted = model.deletion_ext;
+    const double inserted =
+        model.insertion_ext +
+        *std::min_element(model.nuc_freqs.begin(), model.nuc_freqs.end());
+    const vector<double>& D = dp.diag[2].D;
+    auto bound = [&](int i, int d) {
+        int k = m - n + d - 2 * i;  // rows left minus columns left
+        return D[i] + (k > 0 ? k * deleted : -k * inserted);
+    };
+    // nucleotide frequency costs of the first j nucleotides of the query
+    vector<double> freqs(n + 1, 0.0);
+    for(int j = 0; j < n; j++) {
+        freqs[j + 1] = freqs[j] + model.nuc_freq(seq_b[j]);
+    }
+
+    // best cell reached, with its cost and state (as stored in Bd)
+    double top = -numeric_limits<double>::infinity();
+    int top_i = 0, top_j = 0, top_state = 0;
+    double top_cost = 0.0;
+
+    // anti-diagonals in a row that must fall more than x_drop behind
+    const int patience = 60;
+    size_t count = 0;
+    bool stopped = false;
+    int below = 0;
+    int lo = 1, hi = 0;  // live rows of the last anti-diagonal
+    for(int d = 1; d < m + n + 1; d++) {
+        int r_lo = max(lo, max(1, d - n)), r_hi = min(hi + 1, min(m, d - 1));
+        dp.step(d, r_lo, r_hi);
+        if(r_lo > r_hi) {
+            continue;  // anti-diagonal 1 has no inner cells
+        }
+        count += r_hi - r_lo + 1;
+
+        // rows next to the range were not written and hold older values
+        if(r_lo > 1) {
+            dp.clear(r_lo - 1);
+        }
+        if(r_hi + 1 < d) {
+            dp.clear(r_hi + 1);
+        }
+
+        double best = bound(r_lo, d);
+        for(int i = r_lo + 1; i < r_hi + 1; i++) {
+            best = min(best, bound(i, d));
+        }
+        lo = r_lo;
+        hi = r_hi;
+        while(lo < hi && bound(lo, d) > best + x_drop) {
+            lo++;
+        }
+        while(hi > lo && bound(hi, d) > best + x_drop) {
+            hi--;
+        }
+
+        double high = -numeric_limits<double>::infinity();
+        for(int i = r_lo; i < r_hi + 1; i++) {
+            double score = freqs[d - i] - D[i];
+            high = max(high, score);
+            // an insertion cannot follow a deletion
+            int state = static_cast<int>(dp.diag[2].Bd[i]);
+            if(score > top && (state != 2 || d - i == n)) {
+                top = score;
+                top_i = i;
+                top_j = d - i;
+                top_state = state;
+                top_cost = D[i];
+            }
+        }
+        below = high < top - x_drop ? below + 1 : 0;
+        if(below == patience) {
+            stopped = true;
+            break;
+        }
+    }
+    if(cells != nullptr) {
+        *cells = count;
+    }
+    if(!stopped) {
+        return dp.weight();
+    }
+
+    // rest of the query inserted, then the rest of the reference deleted
+    double weight = top_cost;
+    int state = top_state;
+    for(int j = top_j + 1; j < n + 1; j++) {
+        double freq = model.nuc_freq(seq_b[j - 1]);
+        weight += state == 1 ? model.insertion_ext + freq
+                             : model.insertion + freq + model.no_insertion_ext;
+        *B.cell(top_i, j) = traceback_t::pack(1, state == 1 ? 1 : 2, -1);
+        state = 1;
+    }
+    for(int i = top_i + 1; i < m + 1; i++) {
+        weight += state == 0 ? model.no_insertion + model.deletion +
+                                   model.no_deletion_ext
+                  : state == 1 ? model.no_deletion_ext + model.deletion
+                               : model.deletion_ext;
+        *B.cell(i, n) = traceback_t::pack(2, -1, state == 2 ? 1 : 2);
+        state = 2;
+    }
+    return static_cast<float>(weight);
+}
+
+/* Check that the reference (first sequence), and with both the second
+ * sequence as well, is a whole number of codons. Otherwise print an error and
+ * return EXIT_FAILURE. */
+int check_codon_lengths(const vector<string>& sequences, bool both) {
+    if(both &&
+       (sequences[0].length() % 3 != 0 || sequences[1].length() % 3 != 0)) {
+        cerr << "The length of both sequences must be a multiple of 3. Exiting!"
+             << endl;
+        return EXIT_FAILURE;
+    }
+    if(sequences[0].length() % 3 != 0) {
+        cerr << "Reference coding sequence length must be a multiple of 3 ("
+             << sequences[0].length() << "). Exiting!" << endl;
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
 
 /* Dynamic Programming implementation of Marginal MG94 model*/
-int mg94_marginal(vector<string> sequences, alignment_t& aln, Matrix64f& P_m) {
+int mg94_marginal(vector<string> sequences, alignment_t& aln, Matrix64f& P_m,
+                  const indel_params_t& indel) {
     // P matrix for marginal Muse and Gaut codon model
     Eigen::Tensor<double, 3> p(64, 3, 4);
 
@@ -36,151 +583,298 @@ int mg94_marginal(vector<string> sequences, alignment_t& aln, Matrix64f& P_m) {
     int m = sequences[0].length();
     int n = sequences[1].length();
 
-    // ensure that length of first sequence (reference) is multiple of 3
-    if(m % 3 != 0) {
-        cout << "Reference coding sequence length must be a multiple of 3 ("
-             << m << "). Exiting!" << endl;
-        exit(EXIT_FAILURE);
+    if(check_codon_lengths(sequences) != 0) {
+        return EXIT_FAILURE;
     }
 
-    // DP matrices for match/mismatch (D), insertion (P), and deletion (Q)
-    Eigen::MatrixXf D = Eigen::MatrixXf::Constant(
-        m + 1, n + 1, std::numeric_limits<float>::max());
-    Eigen::MatrixXf P = Eigen::MatrixXf::Constant(
-        m + 1, n + 1, std::numeric_limits<float>::max());
-    Eigen::MatrixXf Q = Eigen::MatrixXf::Constant(
-        m + 1, n + 1, std::numeric_limits<float>::max());
-
-    // backtracking info matrices for match/mismatch (Bd), insert (Bp), and
+    // backtracking info for match/mismatch (Bd), insert (Bp), and
     // deletion (Bq)
-    Eigen::MatrixXd Bd = Eigen::MatrixXd::Constant(m + 1, n + 1, -1);
-    Eigen::MatrixXd Bp = Eigen::MatrixXd::Constant(m + 1, n + 1, -1);
-    Eigen::MatrixXd Bq = Eigen::MatrixXd::Constant(m + 1, n + 1, -1);
-
-    double insertion = log(0.001);
-    double deletion = log(0.001);
-    double insertion_ext = log(1.0 - (1.0 / 6.0));
-    double deletion_ext = log(1.0 - (1.0 / 6.0));
-    double no_insertion = log(1.0 - 0.001);
-    double no_deletion = log(1.0 - 0.001);
-    double no_insertion_ext = log(1.0 / 6.0);
-    double no_deletion_ext = log(1.0 / 6.0);
-
-    Vector5d nuc_freqs;
-    nuc_freqs << log(0.308), log(0.185), log(0.199), log(0.308), log(0.25);
-
-    // DP and backtracking matrices initialization
-
-    // fill first values on D that are independent
-    D(0, 0) = 0.0;  // 0.0;
-    Bd(0, 0) = 0;
-    D(0, 1) = -insertion - nuc_freqs[nt4_table[seq_b[0]]] - no_insertion_ext;
-    P(0, 1) = -insertion - nuc_freqs[nt4_table[seq_b[0]]] - no_insertion_ext;
-    Bd(0, 1) = 1;
-    Bp(0, 1) = 2;
-    D(1, 0) = -no_insertion - deletion - no_deletion_ext;
-    Q(1, 0) = -no_insertion - deletion - no_deletion_ext;
-    Bd(1, 0) = 2;
-    Bq(1, 0) = 2;
-
-    // fill first row of D
-    if(n + 1 >= 2) {
-        for(int j = 2; j < n + 1; j++) {
-            D(0, j) = D(0, j - 1) - insertion_ext -
-                      nuc_freqs[nt4_table[seq_b[j - 1]]];
-            P(0, j) = P(0, j - 1) - insertion_ext -
-                      nuc_freqs[nt4_table[seq_b[j - 1]]];
-            Bd(0, j) = 1;
-            Bp(0, j) = 1;
-        }
-    }
-
-    // fill first column of D
-    if(m + 1 >= 2) {
-        for(int i = 2; i < m + 1; i++) {
-            D(i, 0) = D(i - 1, 0) - deletion_ext;
-            Q(i, 0) = Q(i - 1, 0) - deletion_ext;
-            Bd(i, 0) = 2;
-            Bq(i, 0) = 1;
-        }
-    }
-
-    string codon;
-    double p1, p2, q1, q2, d;
+    traceback_t B(m + 1, n + 1);
 
-    for(int i = 1; i < m + 1; i++) {
-        codon = seq_a.substr((((i - 1) / 3) * 3), 3);  // current codon
-        for(int j = 1; j < n + 1; j++) {
-            // insertion
-            p1 = P(i, j - 1) - insertion_ext -
-                 nuc_freqs[nt4_table[seq_b[j - 1]]];
-            p2 = Bd(i, j - 1) == 0
-                     ? D(i, j - 1) - insertion -
-                           nuc_freqs[nt4_table[seq_b[j - 1]]] - no_insertion_ext
-                 : Bd(i, j - 1) == 1 ? D(i, j - 1) - insertion_ext -
-                                           nuc_freqs[nt4_table[seq_b[j - 1]]]
-                                     : numeric_limits<double>::max();
-            P(i, j) = min(p1, p2);
-            Bp(i, j) =
-                p1 < p2
-                    ? 1
-                    : 2;  // 1 is insertion extension, 2 is insertion opening
+    score_model_t model(seq_a, p, indel);
+    aln.weight = mg94_marginal_diagonal(seq_a, seq_b, model, B);  // weight
 
-            // deletion
-            q1 = Q(i - 1, j) - deletion_ext;
-            q2 = Bd(i - 1, j) == 0
-                     ? D(i - 1, j) - no_insertion - deletion - no_deletion_ext
-                 : Bd(i - 1, j) == 1 ? D(i - 1, j) - no_deletion_ext - deletion
-                                     : D(i - 1, j) - deletion_ext;
-            Q(i, j) = min(q1, q2);
-            Bq(i, j) =
-                q1 < q2 ? 1
-                        : 2;  // 1 is deletion extension, 2 is deletion opening
+    // backtracking to obtain alignment
+    return backtracking(B, seq_a, seq_b, aln);
+}
 
-            // match/mismatch
-            if(Bd(i - 1, j - 1) == 0) {
-                d = D(i - 1, j - 1) - no_insertion - no_deletion -
-                    log(transition(codon, (i) % 3, seq_b[j - 1], p));
-            } else if(Bd(i - 1, j - 1) == 1) {
-                d = D(i - 1, j - 1) - no_deletion -
-                    log(transition(codon, (i) % 3, seq_b[j - 1], p));
-            } else {
-                d = D(i - 1, j - 1) -
-                    log(transition(codon, (i) % 3, seq_b[j - 1], p));
+/* Marginal MG94 alignment filled with an X-drop rule (see
+ * mg94_marginal_xdrop_diagonal). The number of DP cells filled is stored in
+ * cells. */
+int mg94_marginal_xdrop(vector<string> sequences, alignment_t& aln,
+                        Matrix64f& P_m, double x_drop, size_t& cells,
+                        const indel_params_t& indel) {
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+    mg94_marginal_p(p, P_m);
+
+    string seq_a = sequences[0];
+    string seq_b = sequences[1];
+    int m = sequences[0].length();
+    int n = sequences[1].length();
+
+    if(check_codon_lengths(sequences) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    traceback_t B(m + 1, n + 1);
+    score_model_t model(seq_a, p, indel);
+    aln.weight =
+        mg94_marginal_xdrop_diagonal(seq_a, seq_b, model, B, x_drop, &cells);
+
+    return backtracking(B, seq_a, seq_b, aln);
+}
+
+/* Fill the marginal MG94 DP of up to batch_lanes() pairs at once, one pair per
+ * lane, pair l scored with models[l]. Rows of all pairs are filled in lockstep
+ * up to the longest pair; cells outside the matrices of a pair are computed
+ * but not stored. Operations and comparisons are the same as in
+ * frameshift_fill_block, giving identical weights and backtracking info (stored
+ * in (*B)[l] for pair l, or not kept if B is null). Returns the weights. */
+vector<float> mg94_marginal_lanes(const vector<const vector<string>*>& pairs,
+                                  const vector<score_model_t>& models,
+                                  vector<unique_ptr<traceback_t>>* B) {
+    const int L = batch_lanes();
+    int lanes = pairs.size();
+
+    const score_model_t& model = models[0];
+
+    vector<int> m(L, 0), n(L, 0);
+    for(int l = 0; l < lanes; l++) {
+        m[l] = (*pairs[l])[0].length();
+        n[l] = (*pairs[l])[1].length();
+    }
+    int m_max = *max_element(m.begin(), m.end());
+    int n_max = *max_element(n.begin(), n.end());
+
+    // emission costs of each nucleotide (A, C, G, T, N) at reference position
+    // i, nucleotides of seq_b, and their frequencies; element [x * L + l]
+    // belongs to lane l
+    vector<double> emission(5 * L * static_cast<size_t>(m_max + 1), 0.0);
+    vector<int> nuc_b(L * static_cast<size_t>(n_max + 1), 4);
+    vector<double> freq_b(L * static_cast<size_t>(n_max + 1), 0.0);
+    vector<dp_line_t> top(L), left(L);
+    for(int l = 0; l < lanes; l++) {
+        const string& seq_a = (*pairs[l])[0];
+        const string& seq_b = (*pairs[l])[1];
+        for(int i = 1; i < m[l] + 1; i++) {
+            for(int b = 0; b < 5; b++) {
+                emission[(5 * i + b) * L + l] = models[l].emission_row(i)[b];
             }
+        }
+        for(int j = 1; j < n[l] + 1; j++) {
+            nuc_b[j * L + l] = score_model_t::nuc(seq_b[j - 1]);
+            freq_b[j * L + l] = model.nuc_freq(seq_b[j - 1]);
+        }
+        mg94_marginal_border(seq_a, seq_b, model, top[l], left[l]);
+        if(B == nullptr) continue;
 
-            // D[i,j] = highest weight between insertion, deletion, and
-            // match/mismatch
-            //	in this case, lowest (-log(weight)) value
-            if(d < P(i, j)) {
-                if(d < Q(i, j)) {
-                    D(i, j) = d;
-                    Bd(i, j) = 0;
-                } else {
-                    D(i, j) = Q(i, j);
-                    Bd(i, j) = 2;
-                }
-            } else {
-                if(P(i, j) < Q(i, j)) {
-                    D(i, j) = P(i, j);
-                    Bd(i, j) = 1;
-                } else {
-                    D(i, j) = Q(i, j);
-                    Bd(i, j) = 2;
+        // first row and column of backtracking info
+        B->emplace_back(new traceback_t(m[l] + 1, n[l] + 1));
+        uint8_t* row = (*B)[l]->row(0);
+        row[0] = traceback_t::pack(0, -1, -1);
+        for(int j = 1; j < n[l] + 1; j++) {
+            row[j] = traceback_t::pack(1, j == 1 ? 2 : 1, -1);
+        }
+        for(int i = 1; i < m[l] + 1; i++) {
+            *(*B)[l]->cell(i, 0) = traceback_t::pack(2, -1, i == 1 ? 2 : 1);
+        }
+    }
+
+    // previous and current rows of all lanes
+    double max_f = std::numeric_limits<float>::max();
+    size_t size = L * static_cast<size_t>(n_max + 1);
+    lanes_row_t prev{vector<double>(size, max_f), vector<double>(size, max_f),
+                     vector<double>(size, max_f), vector<double>(size, -1.0)};
+    lanes_row_t cur = prev;
+    vector<double> em(size), bp(size), bq(size);
+    vector<float> weights(lanes);
+
+    for(int l = 0; l < lanes; l++) {
+        for(int j = 0; j < n[l] + 1; j++) {
+            prev.D[j * L + l] = top[l].D(j);
+            prev.P[j * L + l] = top[l].P(j);
+            prev.Q[j * L + l] = top[l].Q(j);
+            prev.Bd[j * L + l] = top[l].Bd(j);
+        }
+        if(m[l] == 0) weights[l] = top[l].D(n[l]);
+    }
+
+    const simd_kernels_t& kernels = simd_kernels();
+
+    for(int i = 1; i < m_max + 1; i++) {
+        for(int l = 0; l < lanes; l++) {
+            bool in = i < m[l] + 1;
+            cur.D[l] = in ? left[l].D(i) : max_f;
+            cur.P[l] = in ? left[l].P(i) : max_f;
+            cur.Q[l] = in ? left[l].Q(i) : max_f;
+            cur.Bd[l] = in ? left[l].Bd(i) : -1.0;
+        }
+        const double* em_i = &emission[5 * L * static_cast<size_t>(i)];
+        for(size_t x = L; x < size; x += L) {
+            for(int l = 0; l < L; l++) {
+                em[x + l] = em_i[nuc_b[x + l] * L + l];
+            }
+        }
+
+        kernels.lanes_row(model, L, cur, prev, freq_b.data(), em.data(),
+                          bp.data(), bq.data());
+
+        // per-lane backtracking info and weights
+        for(int l = 0; l < lanes; l++) {
+            if(i > m[l]) continue;
+            if(B != nullptr) {
+                uint8_t* row = (*B)[l]->row(i);
+                for(int j = 1; j < n[l] + 1; j++) {
+                    size_t x = j * L + l;
+                    row[j] = traceback_t::pack(static_cast<int>(cur.Bd[x]),
+                                               static_cast<int>(bp[x]),
+                                               static_cast<int>(bq[x]));
                 }
             }
+            if(i == m[l]) weights[l] = cur.D[n[l] * L + l];
         }
+        swap(prev, cur);
     }
 
-    aln.weight = D(m, n);  // weight
+    return weights;
+}
 
-    // backtracking to obtain alignment
-    return backtracking(Bd, Bp, Bq, seq_a, seq_b, aln);
+/* Align many pairs of sequences with the marginal MG94 model, batch_lanes()
+ * pairs at a time (see mg94_marginal_lanes). Pairs are grouped by length so
+ * that lanes of a group do similar work. Results are the same as aligning
+ * each pair with mg94_marginal. */
+int mg94_marginal_batch(const vector<vector<string>>& pairs,
+                        vector<alignment_t>& alns, Matrix64f& P_m,
+                        const indel_params_t& indel) {
+    // P matrix for marginal Muse and Gaut codon model
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+
+    mg94_marginal_p(p, P_m);
+
+    for(auto& seqs : pairs) {
+        if(check_codon_lengths(seqs) != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    vector<size_t> order(pairs.size());
+    for(size_t k = 0; k < order.size(); k++) order[k] = k;
+    stable_sort(order.begin(), order.end(), [&pairs](size_t a, size_t b) {
+        return make_pair(pairs[a][0].length(), pairs[a][1].length()) <
+               make_pair(pairs[b][0].length(), pairs[b][1].length());
+    });
+
+    alns.resize(pairs.size());
+    const size_t L = batch_lanes();
+    for(size_t k = 0; k < order.size(); k += L) {
+        vector<const vector<string>*> group;
+        for(size_t g = k; g < min(order.size(), k + L); g++) {
+            group.push_back(&pairs[order[g]]);
+        }
+        vector<score_model_t> models;
+        for(auto* seqs : group) {
+            models.emplace_back((*seqs)[0], p, indel);
+        }
+        vector<unique_ptr<traceback_t>> B;
+        vector<float> weights = mg94_marginal_lanes(group, models, &B);
+
+        // per-lane backtracking
+        for(size_t l = 0; l < group.size(); l++) {
+            alignment_t& aln = alns[order[k + l]];
+            aln.weight = weights[l];
+            if(backtracking(*B[l], (*group[l])[0], (*group[l])[1], aln) != 0) {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Weights of the marginal MG94 alignment of one pair under each P matrix of
+ * P_ms (e.g. one per branch length). The matrices are carried in the lanes
+ * of a single sweep (see mg94_marginal_lanes), batch_lanes() at a time, without
+ * backtracking info; the pair is then aligned with the P matrix of lowest
+ * weight (the first one on ties). */
+int mg94_marginal_branches(vector<string> sequences, alignment_t& aln,
+                           const vector<Matrix64f>& P_ms,
+                           vector<float>& weights,
+                           const indel_params_t& indel) {
+    if(check_codon_lengths(sequences) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // P matrix for marginal Muse and Gaut codon model
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+
+    weights.clear();
+    const size_t L = batch_lanes();
+    for(size_t k = 0; k < P_ms.size(); k += L) {
+        size_t lanes = min(P_ms.size() - k, L);
+        vector<const vector<string>*> group(lanes, &sequences);
+        vector<score_model_t> models;
+        for(size_t l = 0; l < lanes; l++) {
+            mg94_marginal_p(p, P_ms[k + l]);
+            models.emplace_back(sequences[0], p, indel);
+        }
+        vector<float> w = mg94_marginal_lanes(group, models, nullptr);
+        weights.insert(weights.end(), w.begin(), w.end());
+    }
+
+    size_t best = min_element(weights.begin(), weights.end()) - weights.begin();
+    Matrix64f P_m = P_ms[best];
+    return mg94_marginal(sequences, aln, P_m, indel);
+}
+
+/* Weight of the alignment with gap policy Gaps without backtracking. Only
+ * Gaps::step + 1 rows (and the first Gaps::step columns) of the DP matrices
+ * are kept. */
+template <class Gaps>
+float gotoh_score_only(const string& seq_a, const string& seq_b,
+                       const score_model_t& model) {
+    int m = seq_a.length();
+    int n = seq_b.length();
+
+    // last rows of DP matrices for match/mismatch (D), insertion (P), and
+    // deletion (Q), and of their backtracking info
+    int window = Gaps::step + 1;
+    float inf = std::numeric_limits<float>::max();
+    rolling_matrix_t<float> D(m + 1, n + 1, window, Gaps::step, inf);
+    rolling_matrix_t<float> P(m + 1, n + 1, window, Gaps::step, inf);
+    rolling_matrix_t<float> Q(m + 1, n + 1, window, Gaps::step, inf);
+    rolling_matrix_t<int> Bd(m + 1, n + 1, window, Gaps::step, -1);
+    rolling_matrix_t<int> Bp(m + 1, n + 1, window, Gaps::step, -1);
+    rolling_matrix_t<int> Bq(m + 1, n + 1, window, Gaps::step, -1);
+
+    gotoh_fill<Gaps>(model, marginal_emission_t(model, seq_b), -m, n, D, P, Q,
+                     Bd, Bp, Bq);
+
+    return D(m, n);
+}
+
+/* Weight of the marginal MG94 alignment without backtracking */
+int mg94_marginal_score_only(vector<string> sequences, alignment_t& aln,
+                             Matrix64f& P_m, const indel_params_t& indel) {
+    // P matrix for marginal Muse and Gaut codon model
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+
+    mg94_marginal_p(p, P_m);
+
+    if(check_codon_lengths(sequences) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    score_model_t model(sequences[0], p, indel);
+    aln.weight = gotoh_score_only<frameshift_gaps_t>(sequences[0],
+                                                     sequences[1], model);
+
+    return 0;
 }
 
-/* Dynamic Programming with no frameshifts*/
+/* Dynamic Programming with no frameshifts. Only the cells reachable with
+ * codon-length gaps are stored (see codon_fill): four rows of the DP matrices
+ * and a third of the backtracking info. */
 int gotoh_noframeshifts(vector<string> sequences, alignment_t& aln,
-                        Matrix64f& P_m) {
+                        Matrix64f& P_m, const indel_params_t& indel) {
     // P matrix for marginal Muse and Gaut codon model
     Eigen::Tensor<double, 3> p(64, 3, 4);
 
@@ -191,256 +885,81 @@ int gotoh_noframeshifts(vector<string> sequences, alignment_t& aln,
     int m = sequences[0].length();
     int n = sequences[1].length();
 
-    // ensure that length of first sequence (reference) is multiple of 3
-    if((m % 3 != 0) || (n % 3 != 0)) {
-        cout << "The length of both sequences must be a multiple of 3. Exiting!"
-             << endl;
-        exit(EXIT_FAILURE);
+    if(check_codon_lengths(sequences, true) != 0) {
+        return EXIT_FAILURE;
     }
 
-    // DP matrices for match/mismatch (D), insertion (P), and deletion (Q)
-    Eigen::MatrixXf D = Eigen::MatrixXf::Constant(
-        m + 1, n + 1, std::numeric_limits<float>::max());
-    Eigen::MatrixXf P = Eigen::MatrixXf::Constant(
-        m + 1, n + 1, std::numeric_limits<float>::max());
-    Eigen::MatrixXf Q = Eigen::MatrixXf::Constant(
-        m + 1, n + 1, std::numeric_limits<float>::max());
+    // last 4 rows of DP matrices for match/mismatch (D), insertion (P), and
+    // deletion (Q)
+    float inf = std::numeric_limits<float>::max();
+    rolling_matrix_t<float> D(m + 1, n + 1, 4, 0, inf);
+    rolling_matrix_t<float> P(m + 1, n + 1, 4, 0, inf);
+    rolling_matrix_t<float> Q(m + 1, n + 1, 4, 0, inf);
 
-    // backtracking info matrices for match/mismatch (Bd), insert (Bp), and
-    // deletion (Bq)
-    Eigen::MatrixXd Bd = Eigen::MatrixXd::Constant(m + 1, n + 1, -1);
-    Eigen::MatrixXd Bp = Eigen::MatrixXd::Constant(m + 1, n + 1, -1);
-    Eigen::MatrixXd Bq = Eigen::MatrixXd::Constant(m + 1, n + 1, -1);
-
-    double insertion = 0.001;
-    double deletion = 0.001;
-    double insertion_ext = 1.0 - (1.0 / 6.0);
-    double deletion_ext = 1.0 - (1.0 / 6.0);
-
-    Vector5d nuc_freqs;
-    nuc_freqs << 0.308, 0.185, 0.199, 0.308, 0.25;
-
-    // DP and backtracking matrices initialization
-
-    // fill first values on D that are independent
-    D(0, 0) = 0.0;
-    Bd(0, 0) = 0;
-    D(0, 3) = P(0, 3) = -log(insertion) - log(nuc_freqs[nt4_table[seq_b[0]]]) -
-                        log(nuc_freqs[nt4_table[seq_b[1]]]) -
-                        log(nuc_freqs[nt4_table[seq_b[2]]]) -
-                        log(1.0 - insertion_ext) - 2 * log(insertion_ext);
-    D(3, 0) = Q(3, 0) = -log(1.0 - insertion) - log(deletion) -
-                        2 * log(deletion_ext) - log(1.0 - deletion_ext);
-    Bd(0, 3) = 1;
-    Bd(3, 0) = Bp(0, 3) = Bq(3, 0) = 2;
-
-    // fill first row of D
-    if(n + 1 >= 6) {
-        for(int j = 6; j < n + 1; j += 3) {
-            D(0, j) = P(0, j) = D(0, j - 3) - 3 * log(insertion_ext) -
-                                log(nuc_freqs[nt4_table[seq_b[j - 3]]]) -
-                                log(nuc_freqs[nt4_table[seq_b[j - 2]]]) -
-                                log(nuc_freqs[nt4_table[seq_b[j - 1]]]);
-            Bd(0, j) = 1;
-            Bp(0, j) = 1;
-        }
-    }
-
-    // fill first column of D
-    if(m + 1 >= 6) {
-        for(int i = 6; i < m + 1; i += 3) {
-            D(i, 0) = D(i - 3, 0) - 3 * log(deletion_ext);
-            Q(i, 0) = Q(i - 3, 0) - 3 * log(deletion_ext);
-            Bd(i, 0) = 2;
-            Bq(i, 0) = 1;
-        }
-    }
-
-    string codon;
-    double p1, p2, q1, q2, d, temp;
-
-    // Cells with only match/mismatch (1,1) & (2,2)
-    codon = seq_a.substr(0, 3);
-    for(int i = 1; i < 3; i++) {
-        D(i, i) = D(i - 1, i - 1) - log(1.0 - insertion) - log(1.0 - deletion) -
-                  log(transition(codon, i % 3, seq_b[i - 1], p));
-        Bd(i, i) = 0;
-    }
-
-    // Second and third row/column (match/mismatch && insertion || deletion)
-    for(int i = 1; i < 3; i++) {
-        for(int j = i + 3; j < n + 1; j += 3) {  // rows
-            codon = seq_a.substr(0, 3);
-            // match/mismatch
-            if(Bd(i - 1, j - 1) == 0) {
-                d = D(i - 1, j - 1) - log(1.0 - insertion) -
-                    log(1.0 - deletion) -
-                    log(transition(codon, (i) % 3, seq_b[j - 1], p));
-            } else if(Bd(i - 1, j - 1) == 1) {
-                d = D(i - 1, j - 1) - log(1.0 - deletion) -
-                    log(transition(codon, (i) % 3, seq_b[j - 1], p));
-            } else {
-                d = D(i - 1, j - 1) -
-                    log(transition(codon, (i) % 3, seq_b[j - 1], p));
-            }
-            // insertion
-            p1 = P(i, j - 3) - 3 * log(insertion_ext) -
-                 log(nuc_freqs[nt4_table[seq_b[j - 3]]]) -
-                 log(nuc_freqs[nt4_table[seq_b[j - 2]]]) -
-                 log(nuc_freqs[nt4_table[seq_b[j - 1]]]);
-            p2 = Bd(i, j - 3) == 0
-                     ? D(i, j - 3) - log(insertion) - 2 * log(insertion_ext) -
-                           log(nuc_freqs[nt4_table[seq_b[j - 3]]]) -
-                           log(nuc_freqs[nt4_table[seq_b[j - 2]]]) -
-                           log(nuc_freqs[nt4_table[seq_b[j - 1]]]) -
-                           log(1.0 - insertion_ext)
-                 : Bd(i, j - 1) == 1
-                     ? D(i, j - 1) - 3 * log(insertion_ext) -
-                           log(nuc_freqs[nt4_table[seq_b[j - 3]]]) -
-                           log(nuc_freqs[nt4_table[seq_b[j - 2]]]) -
-                           log(nuc_freqs[nt4_table[seq_b[j - 1]]])
-                     : numeric_limits<double>::max();
-            P(i, j) = min(p1, p2);
-            Bp(i, j) =
-                p1 < p2
-                    ? 1
-                    : 2;  // 1 is insertion extension, 2 is insertion opening
-            D(i, j) = P(i, j) < d ? P(i, j) : d;
-            Bd(i, j) = P(i, j) < d ? 1 : 0;
-        }
-
-        for(int j = i + 3; j < m + 1; j += 3) {            // columns
-            codon = seq_a.substr((((j - 1) / 3) * 3), 3);  // current codon
-            // match/mismatch
-            if(Bd(j - 1, i - 1) == 0) {
-                d = D(j - 1, i - 1) - log(1.0 - insertion) -
-                    log(1.0 - deletion) -
-                    log(transition(codon, (j) % 3, seq_b[i - 1], p));
-            } else if(Bd(j - 1, i - 1) == 1) {
-                d = D(j - 1, i - 1) - log(1.0 - deletion) -
-                    log(transition(codon, (j) % 3, seq_b[i - 1], p));
-            } else {
-                d = D(j - 1, i - 1) -
-                    log(transition(codon, (j) % 3, seq_b[i - 1], p));
-            }
-            // deletion
-            q1 = Q(j - 3, i) - 3 * log(deletion_ext);
-            q2 = Bd(j - 3, i) == 0
-                     ? D(j - 3, i) - log(1.0 - insertion) - log(deletion) -
-                           log(1.0 - deletion_ext) - 2 * log(deletion_ext)
-                 : Bd(j - 3, i) == 1 ? D(j - 3, i) - log(1.0 - deletion_ext) -
-                                           log(deletion) - 2 * log(deletion_ext)
-                                     : D(j - 3, i) - 3 * log(deletion_ext);
-            Q(j, i) = min(q1, q2);
-            Bq(j, i) =
-                q1 < q2 ? 1
-                        : 2;  // 1 is deletion extension, 2 is deletion opening
-            D(j, i) = Q(j, i) < d ? Q(j, i) : d;
-            Bd(j, i) = Q(j, i) < d ? 1 : 2;
-        }
-    }
-
-    // Cells considering all 3 events (insertion, deletion, match/mismatch)
-    for(int i = 3; i < m + 1; i++) {
-        codon = seq_a.substr((((i - 1) / 3) * 3), 3);  // current codon
-        for(int j = 3; j < n + 1; j += 3) {
-            temp = j;
-            j += i % 3;
-            if(j > n) continue;
-            // match/mismatch
-            if(Bd(i - 1, j - 1) == 0) {
-                d = D(i - 1, j - 1) - log(1.0 - insertion) -
-                    log(1.0 - deletion) -
-                    log(transition(codon, (i) % 3, seq_b[j - 1], p));
-            } else if(Bd(i - 1, j - 1) == 1) {
-                d = D(i - 1, j - 1) - log(1.0 - deletion) -
-                    log(transition(codon, (i) % 3, seq_b[j - 1], p));
-            } else {
-                d = D(i - 1, j - 1) -
-                    log(transition(codon, (i) % 3, seq_b[j - 1], p));
-            }
-            // insertion
-            p1 = P(i, j - 3) - 3 * log(insertion_ext) -
-                 log(nuc_freqs[nt4_table[seq_b[j - 3]]]) -
-                 log(nuc_freqs[nt4_table[seq_b[j - 2]]]) -
-                 log(nuc_freqs[nt4_table[seq_b[j - 1]]]);
-            p2 = Bd(i, j - 3) == 0
-                     ? D(i, j - 3) - log(insertion) - 2 * log(insertion_ext) -
-                           log(nuc_freqs[nt4_table[seq_b[j - 3]]]) -
-                           log(nuc_freqs[nt4_table[seq_b[j - 2]]]) -
-                           log(nuc_freqs[nt4_table[seq_b[j - 1]]]) -
-                           log(1.0 - insertion_ext)
-                 : Bd(i, j - 1) == 1
-                     ? D(i, j - 1) - 3 * log(insertion_ext) -
-                           log(nuc_freqs[nt4_table[seq_b[j - 3]]]) -
-                           log(nuc_freqs[nt4_table[seq_b[j - 2]]]) -
-                           log(nuc_freqs[nt4_table[seq_b[j - 1]]])
-                     : numeric_limits<double>::max();
-            P(i, j) = min(p1, p2);
-            Bp(i, j) =
-                p1 < p2
-                    ? 1
-                    : 2;  // 1 is insertion extension, 2 is insertion opening
-            // deletion
-            q1 = Q(i - 3, j) - 3 * log(deletion_ext);
-            q2 = Bd(i - 3, j) == 0
-                     ? D(i - 3, j) - log(1.0 - insertion) - log(deletion) -
-                           log(1.0 - deletion_ext) - 2 * log(deletion_ext)
-                 : Bd(i - 3, j) == 1 ? D(i - 3, j) - log(1.0 - deletion_ext) -
-                                           log(deletion) - 2 * log(deletion_ext)
-                                     : D(i - 3, j) - 3 * log(deletion_ext);
-            Q(i, j) = min(q1, q2);
-            Bq(i, j) =
-                q1 < q2 ? 1
-                        : 2;  // 1 is deletion extension, 2 is deletion opening
-            // D[i,j] = highest weight between insertion, deletion, and
-            // match/mismatch
-            //	in this case, lowest (-log(weight)) value
-            if(d < P(i, j)) {
-                if(d < Q(i, j)) {
-                    D(i, j) = d;
-                    Bd(i, j) = 0;
-                } else {
-                    D(i, j) = Q(i, j);
-                    Bd(i, j) = 2;
-                }
-            } else {
-                if(P(i, j) < Q(i, j)) {
-                    D(i, j) = P(i, j);
-                    Bd(i, j) = 1;
-                } else {
-                    D(i, j) = Q(i, j);
-                    Bd(i, j) = 2;
-                }
-            }
-            j = temp;
-        }
-    }
+    // backtracking info for match/mismatch (Bd), insert (Bp), and
+    // deletion (Bq) of reachable cells, cell (i, j) at column j / 3
+    traceback_t B(m + 1, n / 3 + 1);
+    codon_view_t<traceback_t::view_t> Bd(B.d());
+    codon_view_t<traceback_t::view_t> Bp(B.p());
+    codon_view_t<traceback_t::view_t> Bq(B.q());
+
+    score_model_t model(seq_a, p, indel);
+    gotoh_fill<codon_gaps_t>(model, marginal_emission_t(model, seq_b), -m, n,
+                             D, P, Q, Bd, Bp, Bq);
 
     aln.weight = D(m, n);  // weight
 
     // backtracking to obtain alignment
-    return backtracking_noframeshifts(Bd, Bp, Bq, seq_a, seq_b, aln);
+    return backtracking_noframeshifts(B, seq_a, seq_b, aln);
 }
-/* Return value from marginal MG94 model p matrix for a given transition */
+/* Return value from marginal MG94 model p matrix for a given transition.
+ * Ambiguous nucleotides (N or anything other than ACGT) in the codon are
+ * averaged over the codons compatible with it, and an ambiguous nuc over the
+ * four nucleotides. */
 double transition(string codon, int position, char nuc,
                   const Eigen::Tensor<double, 3>& p) {
-    position = position == 0 ? 2 : --position;
+    position = position == 0 ? 2 : position - 1;
 
-    if(nuc != 'N') {
-        return p(cod_int(codon), position, nt4_table[nuc]);
-    } else {
-        double val = 0.0;
-        for(int i = 0; i < 4; i++) {
-            val += p(cod_int(codon), position, i);
+    vector<int> codons = compatible_codons(codon);
+    uint8_t n = nt4_table[static_cast<uint8_t>(nuc)];
+    double val = 0.0;
+    for(int cod : codons) {
+        if(n < 4) {
+            val += p(cod, position, n);
+        } else {
+            double sum = 0.0;
+            for(int i = 0; i < 4; i++) {
+                sum += p(cod, position, i);
+            }
+            val += sum / 4.0;
         }
-        return val / 4.0;
     }
+    return val / static_cast<double>(codons.size());
+}
+
+/* Weight of the alignment with no frameshifts without backtracking */
+int gotoh_noframeshifts_score_only(vector<string> sequences, alignment_t& aln,
+                                   Matrix64f& P_m,
+                                   const indel_params_t& indel) {
+    // P matrix for marginal Muse and Gaut codon model
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+
+    mg94_marginal_p(p, P_m);
+
+    if(check_codon_lengths(sequences, true) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    score_model_t model(sequences[0], p, indel);
+    aln.weight = gotoh_score_only<codon_gaps_t>(sequences[0], sequences[1],
+                                                model);
+
+    return 0;
 }
 
 /* Recover alignment given backtracking matrices for DP alignment */
-int backtracking(Eigen::MatrixXd Bd, Eigen::MatrixXd Bp, Eigen::MatrixXd Bq,
-                 string seqa, string seqb, alignment_t& aln) {
+int backtracking(const traceback_t& B, string seqa, string seqb,
+                 alignment_t& aln) {
     int i = seqa.length();
     int j = seqb.length();
 
@@ -450,14 +969,14 @@ int backtracking(Eigen::MatrixXd Bd, Eigen::MatrixXd Bp, Eigen::MatrixXd Bq,
 
     while((i != 0) || (j != 0)) {
         // match/mismatch
-        if(Bd(i, j) == 0) {
+        if(B.bd(i, j) == 0) {
             aln.f.seq_data[0].insert(0, 1, seqa[i - 1]);
             aln.f.seq_data[1].insert(0, 1, seqb[j - 1]);
             i--;
             j--;
             // insertion
-        } else if(Bd(i, j) == 1) {
-            while(Bp(i, j) == 1) {
+        } else if(B.bd(i, j) == 1) {
+            while(B.bp(i, j) == 1) {
                 aln.f.seq_data[0].insert(0, 1, '-');
                 aln.f.seq_data[1].insert(0, 1, seqb[j - 1]);
                 j--;
@@ -467,7 +986,7 @@ int backtracking(Eigen::MatrixXd Bd, Eigen::MatrixXd Bp, Eigen::MatrixXd Bq,
             j--;
             // deletion
         } else {
-            while(Bq(i, j) == 1) {
+            while(B.bq(i, j) == 1) {
                 aln.f.seq_data[0].insert(0, 1, seqa[i - 1]);
                 aln.f.seq_data[1].insert(0, 1, '-');
                 i--;
@@ -481,10 +1000,10 @@ int backtracking(Eigen::MatrixXd Bd, Eigen::MatrixXd Bp, Eigen::MatrixXd Bq,
     return 0;
 }
 
-/* Recover alignment given backtracking matrices for DP alignment */
-int backtracking_noframeshifts(Eigen::MatrixXd Bd, Eigen::MatrixXd Bp,
-                               Eigen::MatrixXd Bq, string seqa, string seqb,
-                               alignment_t& aln) {
+/* Recover alignment with no frameshifts given backtracking info of the
+ * reachable cells, cell (i, j) stored at column j / 3 (see codon_view_t) */
+int backtracking_noframeshifts(const traceback_t& B, string seqa,
+                               string seqb, alignment_t& aln) {
     int i = seqa.length();
     int j = seqb.length();
 
@@ -494,14 +1013,14 @@ int backtracking_noframeshifts(Eigen::MatrixXd Bd, Eigen::MatrixXd Bp,
 
     while((i != 0) || (j != 0)) {
         // match/mismatch
-        if(Bd(i, j) == 0) {
+        if(B.bd(i, j / 3) == 0) {
             aln.f.seq_data[0].insert(0, 1, seqa[i - 1]);
             aln.f.seq_data[1].insert(0, 1, seqb[j - 1]);
             i--;
             j--;
             // insertion
-        } else if(Bd(i, j) == 1) {
-            while(Bp(i, j) == 1) {
+        } else if(B.bd(i, j / 3) == 1) {
+            while(B.bp(i, j / 3) == 1) {
                 for(int h = 0; h < 3; h++) {
                     aln.f.seq_data[0].insert(0, 1, '-');
                     aln.f.seq_data[1].insert(0, 1, seqb[j - 1]);
@@ -515,7 +1034,7 @@ int backtracking_noframeshifts(Eigen::MatrixXd Bd, Eigen::MatrixXd Bp,
             }
             // deletion
         } else {
-            while(Bq(i, j) == 1) {
+            while(B.bq(i, j / 3) == 1) {
                 for(int h = 0; h < 3; h++) {
                     aln.f.seq_data[0].insert(0, 1, seqa[i - 1]);
                     aln.f.seq_data[1].insert(0, 1, '-');
@@ -532,3 +1051,1699 @@ int backtracking_noframeshifts(Eigen::MatrixXd Bd, Eigen::MatrixXd Bp,
 
     return 0;
 }
+
+/* Fill cells (i, c0 + 1) to (i, c1) of the marginal MG94 DP matrices with
+ * frameshift_fill_block. prev holds row i - 1 and cur holds row i, both
+ * indexed relative to column c0; the boundary cell cur(0) must be set by the
+ * caller. Insertion and deletion backtracking info is stored in Bp and Bq. */
+void mg94_marginal_row(int i, int c0, int c1, const marginal_emission_t& em,
+                       const score_model_t& model, dp_line_t& prev,
+                       dp_line_t& cur, Eigen::VectorXi& Bp,
+                       Eigen::VectorXi& Bq) {
+    row_pair_t<Eigen::VectorXf> D(i, c0, prev.D, cur.D);
+    row_pair_t<Eigen::VectorXf> P(i, c0, prev.P, cur.P);
+    row_pair_t<Eigen::VectorXf> Q(i, c0, prev.Q, cur.Q);
+    row_pair_t<Eigen::VectorXi> Bd(i, c0, prev.Bd, cur.Bd);
+    // insertions and deletions only store backtracking info of row i
+    row_pair_t<Eigen::VectorXi> bp(i, c0, Bp, Bp), bq(i, c0, Bq, Bq);
+    frameshift_fill_block(model, em, i, i, c0 + 1, c1, -em.rows(), em.cols(),
+                          D, P, Q, Bd, bp, bq);
+}
+
+/* Copy of cells [start, start + size) of a DP row or column */
+dp_line_t dp_line_segment(const dp_line_t& line, int start, int size) {
+    dp_line_t seg;
+    seg.D = line.D.segment(start, size);
+    seg.P = line.P.segment(start, size);
+    seg.Q = line.Q.segment(start, size);
+    seg.Bd = line.Bd.segment(start, size);
+    return seg;
+}
+
+/* Copy cell k of a DP row or column into cell l of another one */
+void dp_line_copy_cell(const dp_line_t& from, int k, dp_line_t& to, int l) {
+    to.D(l) = from.D(k);
+    to.P(l) = from.P(k);
+    to.Q(l) = from.Q(k);
+    to.Bd(l) = from.Bd(k);
+}
+
+/* First row (top) and first column (left) of the marginal MG94 DP matrices
+ */
+void mg94_marginal_border(const string& seq_a, const string& seq_b,
+                          const score_model_t& model, dp_line_t& top,
+                          dp_line_t& left) {
+    int m = seq_a.length();
+    int n = seq_b.length();
+
+    top = dp_line_t(n + 1);
+    left = dp_line_t(m + 1);
+    top.D(0) = left.D(0) = 0.0;
+    top.Bd(0) = left.Bd(0) = 0;
+    top.D(1) = top.P(1) =
+        model.insertion + model.nuc_freq(seq_b[0]) + model.no_insertion_ext;
+    top.Bd(1) = 1;
+    for(int j = 2; j < n + 1; j++) {
+        top.D(j) =
+            top.D(j - 1) + model.insertion_ext + model.nuc_freq(seq_b[j - 1]);
+        top.P(j) =
+            top.P(j - 1) + model.insertion_ext + model.nuc_freq(seq_b[j - 1]);
+        top.Bd(j) = 1;
+    }
+    left.D(1) = left.Q(1) =
+        model.no_insertion + model.deletion + model.no_deletion_ext;
+    left.Bd(1) = 2;
+    for(int i = 2; i < m + 1; i++) {
+        left.D(i) = left.D(i - 1) + model.deletion_ext;
+        left.Q(i) = left.Q(i - 1) + model.deletion_ext;
+        left.Bd(i) = 2;
+    }
+}
+
+/* Backtracking states: reading Bd, inside an insertion (Bp), or inside a
+ * deletion (Bq) */
+enum trace_state { TRACE_D = 0, TRACE_P = 1, TRACE_Q = 2 };
+
+/* Append the pairwise alignment given by backtracking operations stored in
+ * reverse order ('M' match/mismatch, 'I' insertion, 'D' deletion) */
+void alignment_from_ops(const string& ops, const string& seq_a,
+                        const string& seq_b, alignment_t& aln) {
+    aln.f.seq_data.push_back(string());
+    aln.f.seq_data.push_back(string());
+    int i = 0, j = 0;
+    for(auto op = ops.rbegin(); op != ops.rend(); op++) {
+        aln.f.seq_data[0].push_back(*op == 'I' ? '-' : seq_a[i++]);
+        aln.f.seq_data[1].push_back(*op == 'D' ? '-' : seq_b[j++]);
+    }
+}
+
+/* Solve the block of rows r0..r1 and columns c0..c1 with full matrices and
+ * trace back from cell (r1, c1). Backtracking operations are appended in
+ * reverse order to ops: 'M' match/mismatch, 'I' insertion, 'D' deletion.
+ * Returns true if the path reached cell (0, 0), false if it stopped on row
+ * r0 (top boundary of the block). */
+bool mg94_linear_base(int r0, int r1, int c0, int c1, const dp_line_t& top,
+                      const dp_line_t& left, int state,
+                      const marginal_emission_t& em, const score_model_t& model,
+                      string& ops, float* weight) {
+    int h = r1 - r0, w = c1 - c0;
+    Eigen::MatrixXi Bd = Eigen::MatrixXi::Constant(h + 1, w + 1, -1);
+    Eigen::MatrixXi Bp = Eigen::MatrixXi::Constant(h + 1, w + 1, -1);
+    Eigen::MatrixXi Bq = Eigen::MatrixXi::Constant(h + 1, w + 1, -1);
+    Eigen::VectorXi bp = Eigen::VectorXi::Constant(w + 1, -1);
+    Eigen::VectorXi bq = Eigen::VectorXi::Constant(w + 1, -1);
+
+    dp_line_t prev = top, cur(w + 1);
+    for(int i = r0 + 1; i < r1 + 1; i++) {
+        dp_line_copy_cell(left, i - r0, cur, 0);
+        mg94_marginal_row(i, c0, c1, em, model, prev, cur, bp, bq);
+        Bd.row(i - r0) = cur.Bd.transpose();
+        Bp.row(i - r0) = bp.transpose();
+        Bq.row(i - r0) = bq.transpose();
+        swap(prev, cur);
+    }
+    if(weight != nullptr) *weight = prev.D(w);
+
+    int i = r1, j = c1;
+    while(true) {
+        if(j == 0) {  // first column: only deletions left
+            ops.append(i, 'D');
+            return true;
+        } else if(i == 0) {  // first row: only insertions left
+            ops.append(j, 'I');
+            return true;
+        } else if(i == r0) {
+            return false;
+        }
+        switch(state) {
+        case TRACE_D:
+            if(Bd(i - r0, j - c0) == 0) {
+                ops.push_back('M');
+                i--;
+                j--;
+            } else if(Bd(i - r0, j - c0) == 1) {
+                state = TRACE_P;
+            } else {
+                state = TRACE_Q;
+            }
+            break;
+        case TRACE_P:
+            ops.push_back('I');
+            state = Bp(i - r0, j - c0) == 1 ? TRACE_P : TRACE_D;
+            j--;
+            break;
+        case TRACE_Q:
+            ops.push_back('D');
+            state = Bq(i - r0, j - c0) == 1 ? TRACE_Q : TRACE_D;
+            i--;
+            break;
+        }
+    }
+}
+
+/* Divide-and-conquer step of the linear memory alignment. A forward pass
+ * over rows r0..r1 keeps two rows of the DP and, below the middle row,
+ * propagates for every cell and backtracking state where its path crosses
+ * the middle row (2 * column + 1 if inside a deletion) or that it reaches the
+ * first column (negative). The block is then split at the crossing cell into
+ * a bottom-right and a top-left block. */
+bool mg94_linear_solve(int r0, int r1, int c0, int c1, const dp_line_t& top,
+                       const dp_line_t& left, int state,
+                       const marginal_emission_t& em,
+                       const score_model_t& model, int base_cells, string& ops,
+                       float* weight) {
+    int h = r1 - r0, w = c1 - c0;
+    if(h < 2 || static_cast<int64_t>(h + 1) * (w + 1) <= base_cells) {
+        return mg94_linear_base(r0, r1, c0, c1, top, left, state, em, model,
+                                ops, weight);
+    }
+
+    int mid = (r0 + r1) / 2;
+    dp_line_t prev = top, cur(w + 1), mid_row;
+    Eigen::VectorXi bp = Eigen::VectorXi::Constant(w + 1, -1);
+    Eigen::VectorXi bq = Eigen::VectorXi::Constant(w + 1, -1);
+    Eigen::VectorXi Xd(w + 1), Xp(w + 1), Xq(w + 1);
+    Eigen::VectorXi Xd_prev(w + 1), Xq_prev(w + 1);
+
+    for(int i = r0 + 1; i < r1 + 1; i++) {
+        dp_line_copy_cell(left, i - r0, cur, 0);
+        mg94_marginal_row(i, c0, c1, em, model, prev, cur, bp, bq);
+        if(i == mid) {
+            mid_row = cur;
+            for(int k = 0; k < w + 1; k++) {
+                Xd_prev(k) = 2 * (c0 + k);
+                Xq_prev(k) = 2 * (c0 + k) + 1;
+            }
+        } else if(i > mid) {
+            // first column is only reachable when c0 == 0
+            Xd(0) = Xp(0) = Xq(0) = -1;
+            for(int k = 1; k < w + 1; k++) {
+                Xp(k) = bp(k) == 1 ? Xp(k - 1) : Xd(k - 1);
+                Xq(k) = bq(k) == 1 ? Xq_prev(k) : Xd_prev(k);
+                Xd(k) = cur.Bd(k) == 0   ? Xd_prev(k - 1)
+                        : cur.Bd(k) == 1 ? Xp(k)
+                                         : Xq(k);
+            }
+            swap(Xd, Xd_prev);
+            swap(Xq, Xq_prev);
+        }
+        swap(prev, cur);
+    }
+    if(weight != nullptr) *weight = prev.D(w);
+
+    int cross = state == TRACE_Q ? Xq_prev(w) : Xd_prev(w);
+    if(cross < 0) {  // path reaches the first column below the middle row
+        return mg94_linear_solve(mid, r1, c0, c1, mid_row,
+                                 dp_line_segment(left, mid - r0, r1 - mid + 1),
+                                 state, em, model, base_cells, ops, nullptr);
+    }
+
+    int c = cross / 2;
+    int c_state = cross % 2 == 1 ? TRACE_Q : TRACE_D;
+
+    // bottom-right block: path stays right of column c - 1
+    int cb = max(c - 1, c0);
+    dp_line_t bottom_left;
+    if(cb == c0) {
+        bottom_left = dp_line_segment(left, mid - r0, r1 - mid + 1);
+    } else {
+        // recompute column cb below the middle row
+        bottom_left = dp_line_t(r1 - mid + 1);
+        dp_line_copy_cell(mid_row, cb - c0, bottom_left, 0);
+        prev = dp_line_segment(mid_row, 0, cb - c0 + 1);
+        cur = dp_line_t(cb - c0 + 1);
+        for(int i = mid + 1; i < r1 + 1; i++) {
+            dp_line_copy_cell(left, i - r0, cur, 0);
+            mg94_marginal_row(i, c0, cb, em, model, prev, cur, bp, bq);
+            dp_line_copy_cell(cur, cb - c0, bottom_left, i - mid);
+            swap(prev, cur);
+        }
+    }
+
+    if(mg94_linear_solve(mid, r1, cb, c1,
+                         dp_line_segment(mid_row, cb - c0, c1 - cb + 1),
+                         bottom_left, state, em, model, base_cells, ops,
+                         nullptr)) {
+        return true;
+    }
+
+    // top-left block: from crossing cell (mid, c) to row r0
+    return mg94_linear_solve(r0, mid, c0, c,
+                             dp_line_segment(top, 0, c - c0 + 1),
+                             dp_line_segment(left, 0, mid - r0 + 1), c_state,
+                             em, model, base_cells, ops, nullptr);
+}
+
+/* Marginal MG94 alignment in linear memory (divide-and-conquer on rows) that
+ * returns the same alignment and weight as mg94_marginal. Blocks with at most
+ * base_cells cells are solved with full matrices. */
+int mg94_marginal_linear(vector<string> sequences, alignment_t& aln,
+                         Matrix64f& P_m, int base_cells,
+                         const indel_params_t& indel) {
+    // P matrix for marginal Muse and Gaut codon model
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+
+    mg94_marginal_p(p, P_m);
+
+    string seq_a = sequences[0];
+    string seq_b = sequences[1];
+    int m = sequences[0].length();
+    int n = sequences[1].length();
+
+    if(check_codon_lengths(sequences) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // first row and first column of the DP matrices
+    dp_line_t top, left;
+    score_model_t model(seq_a, p, indel);
+    mg94_marginal_border(seq_a, seq_b, model, top, left);
+
+    string ops;
+    marginal_emission_t em(model, seq_b);
+    mg94_linear_solve(0, m, 0, n, top, left, TRACE_D, em, model, base_cells,
+                      ops, &aln.weight);
+
+    // recover alignment from backtracking operations
+    alignment_from_ops(ops, seq_a, seq_b, aln);
+
+    return 0;
+}
+
+/* Marginal MG94 alignment with backtracking info spilled to a scratch file in
+ * scratch_dir. Only two rows of the DP matrices are kept in memory, rows of
+ * backtracking info are written sequentially and paged back in reverse order
+ * during backtracking. max_memory bounds the bytes of mapped backtracking
+ * rows plus DP rows (at least one row of each is kept). Returns the same
+ * alignment and weight as mg94_marginal. */
+int mg94_marginal_scratch(vector<string> sequences, alignment_t& aln,
+                          Matrix64f& P_m, const string& scratch_dir,
+                          size_t max_memory, const indel_params_t& indel) {
+    // P matrix for marginal Muse and Gaut codon model
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+
+    mg94_marginal_p(p, P_m);
+
+    string seq_a = sequences[0];
+    string seq_b = sequences[1];
+    int m = sequences[0].length();
+    int n = sequences[1].length();
+
+    if(check_codon_lengths(sequences) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    dp_line_t top, left;
+    score_model_t model(seq_a, p, indel);
+    mg94_marginal_border(seq_a, seq_b, model, top, left);
+
+    // memory left for backtracking rows after the DP rows and the border
+    size_t resident = (3 * sizeof(float) + 3 * sizeof(int)) *
+                      (2 * static_cast<size_t>(n + 1) + m + 1);
+    size_t window = max_memory > resident ? max_memory - resident : 0;
+
+    traceback_t B(m + 1, n + 1, scratch_dir, window);
+
+    // first row: insertions only
+    uint8_t* row = B.row(0);
+    row[0] = traceback_t::pack(0, -1, -1);
+    for(int j = 1; j < n + 1; j++) {
+        row[j] = traceback_t::pack(1, j == 1 ? 2 : 1, -1);
+    }
+
+    marginal_emission_t em(model, seq_b);
+    dp_line_t prev = top, cur(n + 1);
+    Eigen::VectorXi bp(n + 1), bq(n + 1);
+    for(int i = 1; i < m + 1; i++) {
+        dp_line_copy_cell(left, i, cur, 0);
+        mg94_marginal_row(i, 0, n, em, model, prev, cur, bp, bq);
+        row = B.row(i);
+        row[0] = traceback_t::pack(2, -1, i == 1 ? 2 : 1);
+        for(int j = 1; j < n + 1; j++) {
+            row[j] = traceback_t::pack(cur.Bd(j), bp(j), bq(j));
+        }
+        swap(prev, cur);
+    }
+
+    aln.weight = prev.D(n);  // weight
+
+    // backtracking to obtain alignment
+    return backtracking(B, seq_a, seq_b, aln);
+}
+
+/* Marginal MG94 alignment with the DP filled in square tiles of tile cells
+ * using up to threads threads (see wavefront). A tile reads the last row of
+ * the tile above it and the last column of the tile to its left, which are
+ * kept for all tiles, and stores its backtracking info in a shared traceback.
+ * Results are the same as mg94_marginal. */
+int mg94_marginal_tiled(vector<string> sequences, alignment_t& aln,
+                        Matrix64f& P_m, int threads, int tile,
+                        const indel_params_t& indel) {
+    // P matrix for marginal Muse and Gaut codon model
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+
+    mg94_marginal_p(p, P_m);
+
+    string seq_a = sequences[0];
+    string seq_b = sequences[1];
+    int m = sequences[0].length();
+    int n = sequences[1].length();
+
+    if(check_codon_lengths(sequences) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    dp_line_t top, left;
+    score_model_t model(seq_a, p, indel);
+    mg94_marginal_border(seq_a, seq_b, model, top, left);
+
+    traceback_t B(m + 1, n + 1);
+
+    // first row and column of backtracking info
+    uint8_t* row = B.row(0);
+    row[0] = traceback_t::pack(0, -1, -1);
+    for(int j = 1; j < n + 1; j++) {
+        row[j] = traceback_t::pack(1, j == 1 ? 2 : 1, -1);
+    }
+    for(int i = 1; i < m + 1; i++) {
+        *B.cell(i, 0) = traceback_t::pack(2, -1, i == 1 ? 2 : 1);
+    }
+
+    // last row of each row of tiles and last column of each column of tiles
+    int tile_rows = wavefront_tiles(m, tile);
+    int tile_cols = wavefront_tiles(n, tile);
+    vector<dp_line_t> bottom(tile_rows, dp_line_t(n + 1));
+    vector<dp_line_t> right(tile_cols, dp_line_t(m + 1));
+    marginal_emission_t em(model, seq_b);
+
+    // fill rows r0 + 1 to r1 and columns c0 + 1 to c1
+    auto fill = [&](int r, int c) {
+        int r0 = r * tile, r1 = min(m, r0 + tile);
+        int c0 = c * tile, c1 = min(n, c0 + tile);
+        int w = c1 - c0;
+        const dp_line_t& side = c == 0 ? left : right[c - 1];
+        const dp_line_t& above = r == 0 ? top : bottom[r - 1];
+        dp_line_t prev = dp_line_segment(above, c0, w + 1);
+        dp_line_t cur(w + 1);
+        Eigen::VectorXi bp(w + 1), bq(w + 1);
+        for(int i = r0 + 1; i < r1 + 1; i++) {
+            dp_line_copy_cell(side, i, cur, 0);
+            mg94_marginal_row(i, c0, c1, em, model, prev, cur, bp, bq);
+            uint8_t* row = B.row(i);
+            for(int k = 1; k < w + 1; k++) {
+                row[c0 + k] = traceback_t::pack(cur.Bd(k), bp(k), bq(k));
+            }
+            dp_line_copy_cell(cur, w, right[c], i);
+            swap(prev, cur);
+        }
+        // column c0 belongs to the tile to the left, if any
+        for(int k = c == 0 ? 0 : 1; k < w + 1; k++) {
+            dp_line_copy_cell(prev, k, bottom[r], c0 + k);
+        }
+    };
+    wavefront(tile_rows, tile_cols, threads, fill);
+
+    aln.weight = bottom[tile_rows - 1].D(n);  // weight
+
+    // backtracking to obtain alignment
+    return backtracking(B, seq_a, seq_b, aln);
+}
+
+/* Bytes used by mg94_marginal_checkpoint with checkpoints every k rows */
+size_t checkpoint_bytes(int m, int n, int k) {
+    size_t line = 3 * sizeof(float) + sizeof(int);  // dp_line_t cell
+    size_t checkpoints = (m + k - 1) / k;            // rows 0, k, 2k, ...
+    return (checkpoints + 2) * (n + 1) * line + 2 * (n + 1) * sizeof(int) +
+           (m + 1) * line + (k + 1) * traceback_t::stride(n + 1);
+}
+
+/* Checkpoint interval for mg94_marginal_checkpoint. The interval that uses
+ * the least memory (about 4 * sqrt(m) rows) is increased to the largest one
+ * that fits in max_memory bytes (0: no budget), since the last block of rows
+ * is not recomputed. */
+int checkpoint_interval(int m, int n, size_t max_memory) {
+    int k = max(1, min(m, static_cast<int>(ceil(sqrt(16.0 * m)))));
+    if(max_memory == 0) return k;
+    for(int l = m; l > k; l--) {
+        if(checkpoint_bytes(m, n, l) <= max_memory) return l;
+    }
+    return k;
+}
+
+/* Fill rows r0 + 1 to r1 of the marginal MG94 DP from row r0 (prev) and
+ * store their backtracking info in rows 1 to r1 - r0 of B. On return prev
+ * holds row r1. */
+void mg94_checkpoint_block(int r0, int r1, const marginal_emission_t& em,
+                           const score_model_t& model, const dp_line_t& left,
+                           dp_line_t& prev, dp_line_t& cur, Eigen::VectorXi& bp,
+                           Eigen::VectorXi& bq, traceback_t& B) {
+    int n = em.cols();
+    for(int i = r0 + 1; i < r1 + 1; i++) {
+        dp_line_copy_cell(left, i, cur, 0);
+        mg94_marginal_row(i, 0, n, em, model, prev, cur, bp, bq);
+        uint8_t* row = B.row(i - r0);
+        row[0] = traceback_t::pack(2, -1, i == 1 ? 2 : 1);
+        for(int j = 1; j < n + 1; j++) {
+            row[j] = traceback_t::pack(cur.Bd(j), bp(j), bq(j));
+        }
+        swap(prev, cur);
+    }
+}
+
+/* Marginal MG94 alignment that stores the DP only at every k-th row
+ * (checkpoints) and recomputes blocks of k rows from them during
+ * backtracking, using O(n * sqrt(m)) memory and up to twice the cell updates.
+ * The interval k is chosen from max_memory (bytes, 0: least memory) unless
+ * interval > 0. Returns the same alignment and weight as mg94_marginal. */
+int mg94_marginal_checkpoint(vector<string> sequences, alignment_t& aln,
+                             Matrix64f& P_m, size_t max_memory,
+                             int interval, const indel_params_t& indel) {
+    // P matrix for marginal Muse and Gaut codon model
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+
+    mg94_marginal_p(p, P_m);
+
+    string seq_a = sequences[0];
+    string seq_b = sequences[1];
+    int m = sequences[0].length();
+    int n = sequences[1].length();
+
+    if(check_codon_lengths(sequences) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    int k = interval > 0 ? min(interval, m)
+                         : checkpoint_interval(m, n, max_memory);
+    int blocks = (m + k - 1) / k;
+
+    dp_line_t top, left;
+    score_model_t model(seq_a, p, indel);
+    mg94_marginal_border(seq_a, seq_b, model, top, left);
+
+    // backtracking info of one block of rows; row 0 is the first row of the
+    // DP when the block starts at row 0
+    traceback_t B(k + 1, n + 1);
+    uint8_t* row = B.row(0);
+    row[0] = traceback_t::pack(0, -1, -1);
+    for(int j = 1; j < n + 1; j++) {
+        row[j] = traceback_t::pack(1, j == 1 ? 2 : 1, -1);
+    }
+
+    // forward pass: keep rows 0, k, 2k, ... and backtracking of last block
+    vector<dp_line_t> checkpoints;
+    marginal_emission_t em(model, seq_b);
+    dp_line_t prev = top, cur(n + 1);
+    Eigen::VectorXi bp(n + 1), bq(n + 1);
+    for(int b = 0; b < blocks; b++) {
+        checkpoints.push_back(prev);
+        mg94_checkpoint_block(b * k, min(m, (b + 1) * k), em, model, left,
+                              prev, cur, bp, bq, B);
+    }
+    aln.weight = prev.D(n);  // weight
+
+    // backtracking block by block, recomputing all but the last one
+    string ops;
+    int i = m, j = n;
+    int state = TRACE_D;
+    for(int b = blocks - 1; b >= 0; b--) {
+        int r0 = b * k;
+        if(b < blocks - 1) {
+            prev = checkpoints[b];
+            mg94_checkpoint_block(r0, r0 + k, em, model, left, prev, cur,
+                                  bp, bq, B);
+        }
+        checkpoints.pop_back();
+        while((i != 0 || j != 0) && (i > r0 || r0 == 0)) {
+            switch(state) {
+            case TRACE_D:
+                if(B.bd(i - r0, j) == 0) {
+                    ops.push_back('M');
+                    i--;
+                    j--;
+                } else if(B.bd(i - r0, j) == 1) {
+                    state = TRACE_P;
+                } else {
+                    state = TRACE_Q;
+                }
+                break;
+            case TRACE_P:
+                ops.push_back('I');
+                state = B.bp(i - r0, j) == 1 ? TRACE_P : TRACE_D;
+                j--;
+                break;
+            case TRACE_Q:
+                ops.push_back('D');
+                state = B.bq(i - r0, j) == 1 ? TRACE_Q : TRACE_D;
+                i--;
+                break;
+            }
+        }
+    }
+
+    // recover alignment from backtracking operations
+    alignment_from_ops(ops, seq_a, seq_b, aln);
+
+    return 0;
+}
+
+/* Diagonal band (lo <= j - i <= hi) containing the path of a pairwise
+ * alignment, widened by margin on both sides */
+band_t alignment_band(const alignment_t& aln, int margin) {
+    const string& a = aln.f.seq_data[0];
+    const string& b = aln.f.seq_data[1];
+    int i = 0, j = 0, lo = 0, hi = 0;
+    for(size_t k = 0; k < a.length(); k++) {
+        if(a[k] != '-') i++;
+        if(b[k] != '-') j++;
+        lo = min(lo, j - i);
+        hi = max(hi, j - i);
+    }
+    band_t band;
+    band.lo = max(lo - margin, -i);
+    band.hi = min(hi + margin, j);
+    return band;
+}
+
+/* Estimate a diagonal band (lo <= j - i <= hi) for aligning seq_b against
+ * seq_a from their length difference and a histogram of exact k-mer matches
+ * per diagonal */
+void estimate_band(const string& seq_a, const string& seq_b, int& lo,
+                   int& hi) {
+    const int k = 12;          // k-mer length (24 bits)
+    const int bin = 16;        // diagonals per histogram bin
+    const int margin = 32;     // extra diagonals on each side of the band
+    const size_t max_occ = 8;  // ignore repetitive k-mers
+    const uint32_t mask = (1u << (2 * k)) - 1;
+
+    int m = seq_a.length();
+    int n = seq_b.length();
+
+    lo = min(0, n - m);
+    hi = max(0, n - m);
+
+    // index k-mers of the reference by their end position
+    unordered_map<uint32_t, vector<int>> index;
+    uint32_t kmer = 0;
+    int len = 0;
+    for(int i = 0; i < m; i++) {
+        uint8_t nuc = nt4_table[static_cast<uint8_t>(seq_a[i])];
+        if(nuc > 3) {  // N or other ambiguous nucleotide
+            len = 0;
+            continue;
+        }
+        kmer = ((kmer << 2) | nuc) & mask;
+        if(++len >= k) index[kmer].push_back(i);
+    }
+
+    // histogram of k-mer matches per diagonal
+    vector<int> hist((m + n) / bin + 1, 0);
+    kmer = 0;
+    len = 0;
+    for(int j = 0; j < n; j++) {
+        uint8_t nuc = nt4_table[static_cast<uint8_t>(seq_b[j])];
+        if(nuc > 3) {
+            len = 0;
+            continue;
+        }
+        kmer = ((kmer << 2) | nuc) & mask;
+        if(++len < k) continue;
+        auto hit = index.find(kmer);
+        if(hit == index.end() || hit->second.size() > max_occ) continue;
+        for(int i : hit->second) {
+            hist[(j - i + m) / bin]++;
+        }
+    }
+
+    // diagonals with a significant number of matches
+    int max_count = *max_element(hist.begin(), hist.end());
+    if(max_count < 2) {  // no evidence of homology, use whole matrices
+        lo = -m;
+        hi = n;
+        return;
+    }
+    int threshold = max(2, max_count / 10);
+    for(size_t b = 0; b < hist.size(); b++) {
+        if(hist[b] >= threshold) {
+            int d = static_cast<int>(b) * bin - m;  // first diagonal of bin
+            lo = min(lo, d);
+            hi = max(hi, d + bin - 1);
+        }
+    }
+
+    lo = max(lo - margin, -m);
+    hi = min(hi + margin, n);
+}
+
+/* Trace back a banded DP from cell (m, n). Gaps span step nucleotides (3 with
+ * no frameshifts). Operations are appended in reverse order to ops ('M'
+ * match/mismatch, 'I' insertion, 'D' deletion). Returns false if the path
+ * comes within step diagonals of a band edge that is not a matrix edge.
+ */
+template <class BMatrix>
+bool band_backtracking(const BMatrix& Bd, const BMatrix& Bp, const BMatrix& Bq,
+                       int m, int n, int lo, int hi, int step, string& ops) {
+    int i = m, j = n;
+    int state = TRACE_D;
+    bool inside = true;
+    while((i != 0) || (j != 0)) {
+        if((lo > -m && j - i < lo + step) || (hi < n && j - i > hi - step)) {
+            inside = false;
+        }
+        switch(state) {
+        case TRACE_D:
+            if(Bd(i, j) == 0) {
+                ops.push_back('M');
+                i--;
+                j--;
+            } else if(Bd(i, j) == 1) {
+                state = TRACE_P;
+            } else {
+                state = TRACE_Q;
+            }
+            break;
+        case TRACE_P:
+            state = Bp(i, j) == 1 ? TRACE_P : TRACE_D;
+            ops.append(step, 'I');
+            j -= step;
+            break;
+        case TRACE_Q:
+            state = Bq(i, j) == 1 ? TRACE_Q : TRACE_D;
+            ops.append(step, 'D');
+            i -= step;
+            break;
+        }
+    }
+    return inside;
+}
+
+/* Bytes of the matrices of a banded alignment of a reference of length m in
+ * band lo <= j - i <= hi */
+size_t banded_bytes(int m, int lo, int hi) {
+    return (3 * sizeof(float) + 3 * sizeof(int)) * (m + 1) *
+           static_cast<size_t>(hi - lo + 1);
+}
+
+/* Banded alignment with automatic band estimation (width 0), a band of
+ * half-width width around the length difference (width > 0), or the band
+ * given in band (width < 0). The band is widened and the alignment repeated
+ * until its path stays strictly inside the band (or the band covers the whole
+ * matrices), or until a wider band would take more than max_memory bytes (if
+ * not 0). band holds the last band and whether the path stayed inside of it.
+ * This is a heuristic: a path inside the band does not rule out a cheaper one
+ * that leaves it, so the alignment may differ from the one without a band.
+ * Gaps is the gap policy (see gotoh_kernels.hpp). */
+template <class Gaps>
+int banded_alignment(vector<string>& sequences, alignment_t& aln,
+                     Matrix64f& P_m, band_t& band, int width, size_t max_memory,
+                     const indel_params_t& indel) {
+    // P matrix for marginal Muse and Gaut codon model
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+
+    mg94_marginal_p(p, P_m);
+
+    string seq_a = sequences[0];
+    string seq_b = sequences[1];
+    int m = sequences[0].length();
+    int n = sequences[1].length();
+
+    if(check_codon_lengths(sequences, Gaps::step == 3) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    int step = Gaps::step;
+    if(width > 0) {
+        band.lo = max(min(0, n - m) - width, -m);
+        band.hi = min(max(0, n - m) + width, n);
+    } else if(width == 0) {
+        estimate_band(seq_a, seq_b, band.lo, band.hi);
+    } else {
+        // the band must contain the last cell
+        band.lo = max(min(band.lo, min(0, n - m)), -m);
+        band.hi = min(max(band.hi, max(0, n - m)), n);
+    }
+    // gap opening cells must be inside the band
+    band.lo = min(band.lo, -min(m, 3 * step));
+    band.hi = max(band.hi, min(n, 3 * step));
+
+    score_model_t model(seq_a, p, indel);
+    string ops;
+    float weight;
+    while(true) {
+        float max_f = std::numeric_limits<float>::max();
+        band_matrix_t<float> D(m + 1, n + 1, band.lo, band.hi, max_f);
+        band_matrix_t<float> P(m + 1, n + 1, band.lo, band.hi, max_f);
+        band_matrix_t<float> Q(m + 1, n + 1, band.lo, band.hi, max_f);
+        band_matrix_t<int> Bd(m + 1, n + 1, band.lo, band.hi, -1);
+        band_matrix_t<int> Bp(m + 1, n + 1, band.lo, band.hi, -1);
+        band_matrix_t<int> Bq(m + 1, n + 1, band.lo, band.hi, -1);
+
+        gotoh_fill<Gaps>(model, marginal_emission_t(model, seq_b), band.lo,
+                         band.hi, D, P, Q, Bd, Bp, Bq);
+        weight = D(m, n);
+
+        ops.clear();
+        band.interior = band_backtracking(Bd, Bp, Bq, m, n, band.lo,
+                                          band.hi, step, ops);
+        if(band.interior) break;
+
+        // widen band on both sides by its current width
+        int w = band.hi - band.lo + 1;
+        int lo = max(band.lo - w, -m), hi = min(band.hi + w, n);
+        if(max_memory > 0 && banded_bytes(m, lo, hi) > max_memory) break;
+        band.lo = lo;
+        band.hi = hi;
+    }
+
+    aln.weight = weight;
+
+    // recover alignment from backtracking operations
+    alignment_from_ops(ops, seq_a, seq_b, aln);
+
+    return 0;
+}
+
+/* Marginal MG94 alignment restricted to a band around the main diagonal.
+ * width is the initial band half-width (0 estimates it from the sequences),
+ * and the band is not widened beyond max_memory bytes (0: no limit).
+ */
+int mg94_marginal_banded(vector<string> sequences, alignment_t& aln,
+                         Matrix64f& P, band_t& band, int width,
+                         size_t max_memory, const indel_params_t& indel) {
+    return banded_alignment<frameshift_gaps_t>(sequences, aln, P, band, width,
+                                               max_memory, indel);
+}
+
+/* Alignment with no frameshifts restricted to a band around the main
+ * diagonal. width is the initial band half-width (0 estimates it from the
+ * sequences), and the band is not widened beyond max_memory bytes (0: no
+ * limit). */
+int gotoh_noframeshifts_banded(vector<string> sequences, alignment_t& aln,
+                               Matrix64f& P, band_t& band, int width,
+                               size_t max_memory,
+                               const indel_params_t& indel) {
+    return banded_alignment<codon_gaps_t>(sequences, aln, P, band, width,
+                                          max_memory, indel);
+}
+
+/* Alignment of the codons of seq_b to the codons of seq_a with gaps of whole
+ * codons, on a ninth of the cells of the nucleotide DP. A pair of codons costs
+ * the emissions of its three nucleotides, and gaps cost the same as gaps of
+ * three nucleotides in codon_fill. Nucleotides of seq_b after its last whole
+ * codon are left out. Returns backtracking operations per codon in reverse
+ * order ('M', 'I', 'D', as in alignment_from_ops). */
+string codon_coarse_ops(const string& seq_a, const string& seq_b,
+                        const score_model_t& model) {
+    const int M = seq_a.length() / 3, N = seq_b.length() / 3;
+    const double max_d = std::numeric_limits<double>::max();
+
+    // nucleotides of the codons of seq_b and the costs of inserting them
+    vector<array<int, 3>> nucs(N + 1);
+    vector<double> ins_open(N + 1, max_d), ins_ext(N + 1, max_d);
+    for(int j = 1; j < N + 1; j++) {
+        double codon = 0.0;
+        for(int k = 0; k < 3; k++) {
+            nucs[j][k] = score_model_t::nuc(seq_b[3 * (j - 1) + k]);
+            codon += model.nuc_freq(seq_b[3 * (j - 1) + k]);
+        }
+        ins_open[j] = model.insertion + model.no_insertion_ext +
+                      2 * model.insertion_ext + codon;
+        ins_ext[j] = 3 * model.insertion_ext + codon;
+    }
+    const double del_open = model.no_insertion + model.deletion +
+                            model.no_deletion_ext + 2 * model.deletion_ext;
+    const double del_after_ins =
+        model.no_deletion_ext + model.deletion + 2 * model.deletion_ext;
+    const double del_ext = 3 * model.deletion_ext;
+    const double match_open = model.no_insertion + model.no_deletion;
+
+    // two rows of D, P, Q and the backtracking info of every cell
+    vector<double> D0(N + 1, max_d), P0(N + 1, max_d), Q0(N + 1, max_d);
+    vector<double> D1(N + 1), P1(N + 1), Q1(N + 1);
+    vector<int> Bd0(N + 1, -1), Bd1(N + 1);
+    traceback_t B(M + 1, N + 1);
+
+    for(int i = 0; i < M + 1; i++) {
+        const double* e0 = i > 0 ? model.emission_row(3 * i - 2) : nullptr;
+        const double* e1 = i > 0 ? model.emission_row(3 * i - 1) : nullptr;
+        const double* e2 = i > 0 ? model.emission_row(3 * i) : nullptr;
+        for(int j = 0; j < N + 1; j++) {
+            if(i == 0 && j == 0) {
+                D1[0] = 0.0;
+                P1[0] = Q1[0] = max_d;
+                Bd1[0] = 0;
+                *B.cell(0, 0) = traceback_t::pack(0, -1, -1);
+                continue;
+            }
+            // match/mismatch
+            double d = max_d;
+            if(i > 0 && j > 0) {
+                double e = e0[nucs[j][0]] + e1[nucs[j][1]] + e2[nucs[j][2]];
+                d = Bd0[j - 1] == 0   ? D0[j - 1] + match_open + e
+                    : Bd0[j - 1] == 1 ? D0[j - 1] + model.no_deletion + e
+                                      : D0[j - 1] + e;
+            }
+            // insertion
+            double p = max_d;
+            int bp = -1;
+            if(j > 0) {
+                double p1 = P1[j - 1] + ins_ext[j];
+                double p2 = Bd1[j - 1] == 0 ? D1[j - 1] + ins_open[j] : max_d;
+                p = min(p1, p2);
+                bp = p1 < p2 ? 1 : 2;
+            }
+            // deletion
+            double q = max_d;
+            int bq = -1;
+            if(i > 0) {
+                double q1 = Q0[j] + del_ext;
+                double q2 = Bd0[j] == 0   ? D0[j] + del_open
+                            : Bd0[j] == 1 ? D0[j] + del_after_ins
+                                          : D0[j] + del_ext;
+                q = min(q1, q2);
+                bq = q1 < q2 ? 1 : 2;
+            }
+            P1[j] = p;
+            Q1[j] = q;
+            if(d < p && d < q) {
+                D1[j] = d;
+                Bd1[j] = 0;
+            } else if(p < q) {
+                D1[j] = p;
+                Bd1[j] = 1;
+            } else {
+                D1[j] = q;
+                Bd1[j] = 2;
+            }
+            *B.cell(i, j) = traceback_t::pack(Bd1[j], bp, bq);
+        }
+        std::swap(D0, D1);
+        std::swap(P0, P1);
+        std::swap(Q0, Q1);
+        std::swap(Bd0, Bd1);
+    }
+
+    string ops;
+    band_backtracking(B.d(), B.p(), B.q(), M, N, -M, N, 1, ops);
+    return ops;
+}
+
+/* Marginal MG94 alignment in two stages. The codons of the sequences are
+ * aligned first (see codon_coarse_ops). The DP with gaps of any length is
+ * then filled only in a band around the nucleotide path of that alignment,
+ * coarse_margin nucleotides to each side of it in every row. Near codon gaps,
+ * where frameshifts may move the path, the band covers the box spanned by the
+ * gaps and twice the margin. If the path comes to the edge of the band, the
+ * margins are doubled and the alignment is repeated, as in banded_alignment.
+ */
+int mg94_marginal_coarse(vector<string> sequences, alignment_t& aln,
+                         Matrix64f& P_m, const indel_params_t& indel) {
+    const int near = 24;  // rows before and after a codon gap
+
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+    mg94_marginal_p(p, P_m);
+
+    string seq_a = sequences[0];
+    string seq_b = sequences[1];
+    int m = sequences[0].length();
+    int n = sequences[1].length();
+
+    if(check_codon_lengths(sequences) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    score_model_t model(seq_a, p, indel);
+    string coarse = codon_coarse_ops(seq_a, seq_b, model);
+
+    // columns of the coarse path in each row, and rows near codon gaps
+    vector<int> first(m + 1, n), last(m + 1, 0), gap(m + 1, 0);
+    int i = 0, j = 0;
+    auto visit = [&](int di, int dj) {
+        i += di;
+        j += dj;
+        first[i] = min(first[i], j);
+        last[i] = max(last[i], j);
+    };
+    // gaps less than near nucleotides apart are grouped, and the band covers
+    // the box from the start of a group to its end
+    int i0 = -1, j0 = 0, i1 = 0, j1 = 0;
+    auto group = [&]() {
+        for(int r = i0; r < i1 + 1; r++) {
+            first[r] = min(first[r], j0);
+            last[r] = max(last[r], j1);
+        }
+        for(int r = max(0, i0 - near); r < min(m, i1 + near) + 1; r++) {
+            gap[r] = 1;
+        }
+    };
+    visit(0, 0);
+    for(auto op = coarse.rbegin(); op != coarse.rend(); op++) {
+        if(*op != 'M' && (i0 < 0 || i - i1 > near || j - j1 > near)) {
+            if(i0 >= 0) group();
+            i0 = i;
+            j0 = j;
+        }
+        for(int k = 0; k < 3; k++) {
+            visit(*op != 'I', *op != 'D');
+        }
+        if(*op != 'M') {
+            i1 = i;
+            j1 = j;
+        }
+    }
+    if(i0 >= 0) group();
+    while(j < n) {
+        visit(0, 1);  // nucleotides after the last codon of seq_b
+    }
+
+    string ops;
+    float weight;
+    for(int w = coarse_margin;; w *= 2) {
+        vector<int> lo(m + 1), hi(m + 1);
+        bool whole = true;
+        for(int r = 0; r < m + 1; r++) {
+            int width = gap[r] ? 2 * w : w;
+            lo[r] = max(0, first[r] - width);
+            hi[r] = min(n, last[r] + width);
+            whole = whole && lo[r] == 0 && hi[r] == n;
+        }
+
+        float max_f = std::numeric_limits<float>::max();
+        row_band_matrix_t<float> D(lo, hi, max_f), P(lo, hi, max_f),
+            Q(lo, hi, max_f);
+        row_band_matrix_t<int> Bd(lo, hi, -1), Bp(lo, hi, -1), Bq(lo, hi, -1);
+        marginal_emission_t em(model, seq_b);
+        frameshift_fill_border(model, em, -m, n, D, P, Q, Bd, Bp, Bq);
+        for(int r = 1; r < m + 1; r++) {
+            frameshift_fill_block(model, em, r, r, max(1, lo[r]), hi[r], -m,
+                                  n, D, P, Q, Bd, Bp, Bq);
+        }
+        weight = D(m, n);
+
+        ops.clear();
+        band_backtracking(Bd, Bp, Bq, m, n, -m, n, 1, ops);
+        if(whole) break;
+
+        // the path must stay off band edges that are not matrix edges
+        bool inside = true;
+        i = 0;
+        j = 0;
+        for(auto op = ops.rbegin(); op != ops.rend() && inside; op++) {
+            i += *op != 'I';
+            j += *op != 'D';
+            inside = (lo[i] == 0 || j > lo[i]) && (hi[i] == n || j < hi[i]);
+        }
+        if(inside) break;
+    }
+
+    aln.weight = weight;
+    alignment_from_ops(ops, seq_a, seq_b, aln);
+
+    return 0;
+}
+
+TEST_CASE("[gotoh.cc] check_codon_lengths") {
+    CHECK(check_codon_lengths({"CTCTGG", "CTCTG"}) == 0);
+    CHECK(check_codon_lengths({"CTCTG", "CTCTGG"}) == EXIT_FAILURE);
+    CHECK(check_codon_lengths({"CTCTGG", "CTCTG"}, true) == EXIT_FAILURE);
+    CHECK(check_codon_lengths({"CTCTGG", "CTC"}, true) == 0);
+
+    // entry points report the error instead of exiting
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+    alignment_t aln;
+    CHECK(mg94_marginal({"CTCTG", "CTCTGG"}, aln, P) == EXIT_FAILURE);
+    CHECK(gotoh_noframeshifts({"CTCTGG", "CTCTG"}, aln, P) == EXIT_FAILURE);
+}
+
+TEST_CASE("[gotoh.cc] mg94_marginal_diagonal") {
+    Matrix64f P_m;
+    mg94_p(P_m, 0.0133);
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+    mg94_marginal_p(p, P_m);
+
+    // lengths around the number of lanes, ambiguous nucleotides, and repeats
+    vector<vector<string>> pairs = {
+        {"CTCTGGATAGTG", "CTATAGTG"},
+        {"CTC", "C"},
+        {"CTCTGGATA", "CTCTGGATAGTGCTCTGG"},
+        {"CTNTGGATAGTGNNN", "CTATNGTGA"},
+        {"AAAAAAAAAAAAAAAAAAAAAAAA", "AAAAAAAAAAAAAAAAA"},
+        {"ACGTTAAGGCCTACGTTAAGGCCTACGTTAAGGCCT",
+         "ACGTTAAGCCTTTACGTAAGGCTACGAAAGGCCTAA"}};
+
+    for(auto& seqs : pairs) {
+        int m = seqs[0].length(), n = seqs[1].length();
+        traceback_t B(m + 1, n + 1), B_rows(m + 1, n + 1);
+        score_model_t model(seqs[0], p);
+        float weight = mg94_marginal_diagonal(seqs[0], seqs[1], model, B);
+
+        // row by row fill
+        float inf = std::numeric_limits<float>::max();
+        Eigen::MatrixXf D = Eigen::MatrixXf::Constant(m + 1, n + 1, inf);
+        Eigen::MatrixXf P = Eigen::MatrixXf::Constant(m + 1, n + 1, inf);
+        Eigen::MatrixXf Q = Eigen::MatrixXf::Constant(m + 1, n + 1, inf);
+        auto Bd = B_rows.d(), Bp = B_rows.p(), Bq = B_rows.q();
+        marginal_emission_t em(model, seqs[1]);
+        gotoh_fill<frameshift_gaps_t>(model, em, -m, n, D, P, Q, Bd, Bp, Bq);
+
+        CHECK(weight == D(m, n));
+        for(int i = 0; i < m + 1; i++) {
+            for(int j = 0; j < n + 1; j++) {
+                CHECK(B.bd(i, j) == B_rows.bd(i, j));
+                CHECK(B.bp(i, j) == B_rows.bp(i, j));
+                CHECK(B.bq(i, j) == B_rows.bq(i, j));
+            }
+        }
+    }
+}
+
+TEST_CASE("[gotoh.cc] mg94_marginal_xdrop") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+
+    for(string name : {"001", "002"}) {
+        fasta_t f("../../fasta/example-" + name + ".fasta");
+        REQUIRE(read_fasta(f) == 0);
+        alignment_t aln, aln_xdrop;
+        size_t cells = 0;
+        REQUIRE(mg94_marginal(f.seq_data, aln, P) == 0);
+        REQUIRE(mg94_marginal_xdrop(f.seq_data, aln_xdrop, P, 20.0, cells) ==
+                0);
+        CHECK(aln_xdrop.f.seq_data == aln.f.seq_data);
+        CHECK(aln_xdrop.weight == aln.weight);
+    }
+
+    fasta_t f("../../fasta/example-003.fasta");
+    REQUIRE(read_fasta(f) == 0);
+    const string& ref = f.seq_data[0];
+    size_t m = ref.length();
+
+    SUBCASE("truncated query") {
+        vector<string> seqs = {ref, ref.substr(0, 150)};
+        alignment_t aln, aln_xdrop;
+        size_t cells = 0;
+        REQUIRE(mg94_marginal(seqs, aln, P) == 0);
+        REQUIRE(mg94_marginal_xdrop(seqs, aln_xdrop, P, 20.0, cells) == 0);
+        CHECK(aln_xdrop.f.seq_data == aln.f.seq_data);
+        // the DP rounds each cell to float, the gaps after the stop are not
+        CHECK(aln_xdrop.weight == doctest::Approx(aln.weight));
+        // the trailing deletion costs the same wherever it starts, so only
+        // part of the matrix is dropped
+        CHECK(cells < m * 150);
+    }
+    SUBCASE("partial homology") {
+        // first half shared, second half of the query unrelated
+        string query = ref.substr(0, 210) + f.seq_data[1].substr(210);
+        vector<string> seqs = {ref, query};
+        alignment_t aln, aln_xdrop;
+        size_t cells = 0;
+        REQUIRE(mg94_marginal(seqs, aln, P) == 0);
+        REQUIRE(mg94_marginal_xdrop(seqs, aln_xdrop, P, 20.0, cells) == 0);
+        // the unrelated half falls more than X behind: a heuristic result
+        // that is never better than the full DP
+        CHECK(aln_xdrop.weight >= aln.weight);
+        // the fill stops soon after the shared half, which is aligned as
+        // matches, and the rest is inserted and deleted
+        CHECK(cells < m * m / 20);
+        size_t n = query.length();
+        CHECK(aln_xdrop.f.seq_data[0] ==
+              ref.substr(0, 210) + string(n - 210, '-') + ref.substr(210));
+        CHECK(aln_xdrop.f.seq_data[1] == query + string(m - 210, '-'));
+    }
+    SUBCASE("truncated and diverged queries") {
+        // substitutions at a tenth of the sites and indels at 1% of them
+        // fall more than 20 nats behind in places, unlike a query that is
+        // only homologous up to a point, and must not stop the fill
+        std::mt19937 rng(7);
+        string seq(1500, 'A');
+        for(auto& c : seq) c = "ACGT"[rng() % 4];
+        string diverged;
+        for(size_t i = 0; i < seq.length(); i++) {
+            int r = rng() % 1000;
+            if(r < 5) {
+                diverged += string(1 + rng() % 6, "ACGT"[rng() % 4]);
+                diverged += seq[i];
+            } else if(r < 10) {
+                i += rng() % 6;
+            } else if(r < 110) {
+                const string nucs = "ACGT";
+                diverged += nucs[(nucs.find(seq[i]) + 1 + rng() % 3) % 4];
+            } else {
+                diverged += seq[i];
+            }
+        }
+        string truncated = seq.substr(0, 750);
+        for(int i = 0; i < 750; i++) truncated += "ACGT"[rng() % 4];
+
+        for(const string& query : {diverged, truncated}) {
+            vector<string> seqs = {seq, query};
+            alignment_t aln, aln_xdrop;
+            size_t cells = 0;
+            REQUIRE(mg94_marginal(seqs, aln, P) == 0);
+            REQUIRE(mg94_marginal_xdrop(seqs, aln_xdrop, P, 50.0, cells) ==
+                    0);
+            if(query == diverged) {
+                CHECK(aln_xdrop.f.seq_data == aln.f.seq_data);
+                CHECK(aln_xdrop.weight == aln.weight);
+                CHECK(cells < seq.length() * query.length() / 4);
+            } else {
+                CHECK(aln_xdrop.weight >= aln.weight);
+                // the fill stops soon after the shared part
+                CHECK(cells < seq.length() * query.length() / 10);
+                CHECK(aln_xdrop.f.seq_data[1] ==
+                      query + string(seq.length() - 750, '-'));
+            }
+        }
+    }
+    SUBCASE("query insertions") {
+        // cells on the insertion side of the diagonal must not be dropped
+        std::mt19937 rng(42);
+        string seq(3000, 'A');
+        for(auto& c : seq) c = "ACGT"[rng() % 4];
+        for(int len : {4, 12}) {
+            CAPTURE(len);
+            string query = seq;
+            query.insert(1500, string(len, 'T'));
+            vector<string> seqs = {seq, query};
+            alignment_t aln, aln_xdrop;
+            size_t cells = 0;
+            REQUIRE(mg94_marginal(seqs, aln, P) == 0);
+            REQUIRE(mg94_marginal_xdrop(seqs, aln_xdrop, P, 20.0, cells) ==
+                    0);
+            CHECK(aln_xdrop.f.seq_data == aln.f.seq_data);
+            CHECK(aln_xdrop.weight == aln.weight);
+            CHECK(cells < seq.length() * query.length() / 4);
+        }
+    }
+    SUBCASE("no drop") {
+        // every cell is filled, as in mg94_marginal_diagonal
+        Eigen::Tensor<double, 3> p(64, 3, 4);
+        mg94_marginal_p(p, P);
+        const string& seq_b = f.seq_data[1];
+        size_t n = seq_b.length();
+        score_model_t model(ref, p);
+        traceback_t B(m + 1, n + 1), B_xdrop(m + 1, n + 1);
+        size_t cells = 0;
+        float weight = mg94_marginal_diagonal(ref, seq_b, model, B);
+        CHECK(mg94_marginal_xdrop_diagonal(ref, seq_b, model, B_xdrop, 1e30,
+                                           &cells) == weight);
+        CHECK(cells == m * n);
+        alignment_t aln, aln_xdrop;
+        REQUIRE(backtracking(B, ref, seq_b, aln) == 0);
+        REQUIRE(backtracking(B_xdrop, ref, seq_b, aln_xdrop) == 0);
+        CHECK(aln_xdrop.f.seq_data == aln.f.seq_data);
+    }
+}
+
+TEST_CASE("[gotoh.cc] codon_coarse_ops") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+    mg94_marginal_p(p, P);
+
+    auto test = [&](const string& seq_a, const string& seq_b,
+                    const string& expected) {
+        score_model_t model(seq_a, p);
+        string ops = codon_coarse_ops(seq_a, seq_b, model);
+        std::reverse(ops.begin(), ops.end());
+        CHECK(ops == expected);
+    };
+
+    test("CTCTGGATAGTC", "CTCTGGATAGTC", "MMMM");
+    test("CTCTGGATAGTC", "CTCTGGGTC", "MMDM");
+    test("CTCTGGGTC", "CTCTGGATAGTC", "MMIM");
+    test("CTCTGGGTC", "CTCTGGGTCA", "MMM");  // trailing nucleotide left out
+}
+
+TEST_CASE("[gotoh.cc] mg94_marginal_coarse") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+
+    for(string name : {"001", "002"}) {
+        fasta_t f("../../fasta/example-" + name + ".fasta");
+        REQUIRE(read_fasta(f) == 0);
+        alignment_t aln, aln_coarse;
+        REQUIRE(mg94_marginal(f.seq_data, aln, P) == 0);
+        REQUIRE(mg94_marginal_coarse(f.seq_data, aln_coarse, P) == 0);
+        CHECK(aln_coarse.f.seq_data == aln.f.seq_data);
+        CHECK(aln_coarse.weight == aln.weight);
+    }
+
+    SUBCASE("frameshifts") {
+        fasta_t f("../../fasta/example-003.fasta");
+        REQUIRE(read_fasta(f) == 0);
+        const string& ref = f.seq_data[0];
+        // codon deletion, one-nucleotide insertion, and two-nucleotide deletion
+        string query = ref.substr(0, 60) + ref.substr(66, 90) + "T" +
+                       ref.substr(156, 60) + ref.substr(218);
+        vector<string> seqs = {ref, query};
+        alignment_t aln, aln_coarse;
+        REQUIRE(mg94_marginal(seqs, aln, P) == 0);
+        REQUIRE(mg94_marginal_coarse(seqs, aln_coarse, P) == 0);
+        CHECK(aln_coarse.f.seq_data == aln.f.seq_data);
+        CHECK(aln_coarse.weight == aln.weight);
+    }
+}
+
+TEST_CASE("[gotoh.cc] simd_kernels") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+    mg94_marginal_p(p, P);
+    string seq_a = "ACGTTAAGGCCTACGTTAAGGCCTACGTTAAGGCCT";
+    string seq_b = "ACGTTAAGCCTTTACGTAAGGCTACGAAAGGCCTAA";
+    int m = seq_a.length(), n = seq_b.length();
+    score_model_t model(seq_a, p);
+    vector<vector<string>> pairs = {
+        {seq_a, seq_b}, {"CTCTGG", "CCTGG"}, {"CTC", "C"}};
+
+    // every instruction set supported by the CPU gives identical results
+    isa_t current = active_isa();
+    traceback_t B_ref(m + 1, n + 1);
+    REQUIRE(set_active_isa(isa_t::sse2));
+    float weight = mg94_marginal_diagonal(seq_a, seq_b, model, B_ref);
+    vector<alignment_t> alns_ref;
+    REQUIRE(mg94_marginal_batch(pairs, alns_ref, P) == 0);
+
+    for(isa_t isa : {isa_t::avx2, isa_t::avx512}) {
+        if(!set_active_isa(isa)) continue;
+        string name = isa_name(isa);
+        CAPTURE(name);
+        traceback_t B(m + 1, n + 1);
+        CHECK(mg94_marginal_diagonal(seq_a, seq_b, model, B) == weight);
+        for(int i = 0; i < m + 1; i++) {
+            CHECK(std::equal(B.row(i), B.row(i) + n + 1, B_ref.row(i)));
+        }
+        vector<alignment_t> alns;
+        REQUIRE(mg94_marginal_batch(pairs, alns, P) == 0);
+        for(size_t k = 0; k < pairs.size(); k++) {
+            CHECK(alns[k].f.seq_data == alns_ref[k].f.seq_data);
+            CHECK(alns[k].weight == alns_ref[k].weight);
+        }
+    }
+    set_active_isa(current);
+}
+
+TEST_CASE("[gotoh.cc] mg94_marginal_tiled") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+
+    vector<vector<string>> pairs = {
+        {"CTCTGGATAGTG", "CTATAGTG"},
+        {"CTC", "C"},
+        {"CTCTGGATAGTGAAA", "CTATNGTGA"},
+        {"ACGTTAAGGCCTACGTTAAGGCCTACGTTAAGGCCT",
+         "ACGTTAAGCCTTTACGTAAGGCTACGAAAGGCCTAA"},
+        {"CCCCCCGGGGGGTTTTTTAAAAAA", "CCCGGTTTGGTTTTTTAAAAACCCCAA"}};
+
+    for(auto& seqs : pairs) {
+        alignment_t aln;
+        REQUIRE(mg94_marginal(seqs, aln, P) == 0);
+        // tiles of a few cells, including partial tiles
+        for(int tile : {4, 7, 256}) {
+            for(int threads : {1, 3}) {
+                alignment_t aln_tiled;
+                REQUIRE(mg94_marginal_tiled(seqs, aln_tiled, P, threads,
+                                            tile) == 0);
+                CHECK(aln_tiled.f.seq_data == aln.f.seq_data);
+                CHECK(aln_tiled.weight == aln.weight);
+            }
+        }
+    }
+}
+
+TEST_CASE("[gotoh.cc] mg94_marginal_batch") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+
+    // more pairs than lanes, of different lengths
+    vector<vector<string>> pairs = {
+        {"CTCTGGATAGTG", "CTATAGTG"},
+        {"CTCTGG", "CCTGG"},
+        {"GCGATTGCTGTT", "GCGACTGTT"},
+        {"CTC", "C"},
+        {"CTCTGGATAGTGAAA", "CTATNGTGA"},
+        {"AAAAAAAAAAAAAAAAAAAAAAAA", "AAAAAAAAAAAAAAAAA"},
+        {"ACGTTAAGGCCTACGTTAAGGCCTACGTTAAGGCCT",
+         "ACGTTAAGCCTTTACGTAAGGCTACGAAAGGCCTAA"},
+        {"ATGCCCAAATTTGGGCCCAAATTTGGGTGA", "ATGCCAAATGGGCCCAAAAATTTGGGTGA"},
+        {"CTCTGGATAGTG", "CTCTGGGGATAGTG"},
+        {"ACGTTAAGGGGT", "ACGAAGGGGT"},
+        {"CCCCCCGGGGGGTTTTTTAAAAAA", "CCCGGTTTGGTTTTTTAAAAACCCCAA"}};
+
+    vector<alignment_t> alns;
+    REQUIRE(mg94_marginal_batch(pairs, alns, P) == 0);
+    REQUIRE(alns.size() == pairs.size());
+    for(size_t k = 0; k < pairs.size(); k++) {
+        alignment_t aln;
+        REQUIRE(mg94_marginal(pairs[k], aln, P) == 0);
+        CHECK(alns[k].f.seq_data == aln.f.seq_data);
+        CHECK(alns[k].weight == aln.weight);
+    }
+}
+
+TEST_CASE("[gotoh.cc] mg94_marginal_branches") {
+    vector<string> seqs = {"ACGTTAAGGCCTACGTTAAGGCCTACGTTAAGGCCT",
+                           "ACGTTAAGCCTTTACGTAAGGCTACGAAAGGCCTAA"};
+    vector<double> times;
+    for(int k = 1; k < 2 * batch_lanes() + 2; k++) times.push_back(0.01 * k);
+
+    vector<Matrix64f> P_ms(times.size());
+    for(size_t k = 0; k < times.size(); k++) mg94_p(P_ms[k], times[k]);
+
+    alignment_t aln;
+    vector<float> weights;
+    REQUIRE(mg94_marginal_branches(seqs, aln, P_ms, weights) == 0);
+    REQUIRE(weights.size() == times.size());
+
+    // weights of independent alignments, best one is reported
+    size_t best = 0;
+    for(size_t k = 0; k < times.size(); k++) {
+        alignment_t aln_t;
+        REQUIRE(mg94_marginal(seqs, aln_t, P_ms[k]) == 0);
+        CHECK(weights[k] == aln_t.weight);
+        if(aln_t.weight < weights[best]) best = k;
+    }
+    alignment_t aln_best;
+    REQUIRE(mg94_marginal(seqs, aln_best, P_ms[best]) == 0);
+    CHECK(aln.weight == aln_best.weight);
+    CHECK(aln.f.seq_data == aln_best.f.seq_data);
+}
+
+TEST_CASE("[gotoh.cc] mg94_marginal_score_only") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+
+    vector<vector<string>> pairs = {
+        {"CTCTGGATAGTG", "CTATAGTG"},
+        {"CTCTGG", "CCTGG"},
+        {"GCGATTGCTGTT", "GCGACTGTT"},
+        {"ACGTTAAGGCCTACGTTAAGGCCTACGTTAAGGCCT",
+         "ACGTTAAGCCTTTACGTAAGGCTACGAAAGGCCTAA"}};
+
+    for(auto& seqs : pairs) {
+        alignment_t aln_full, aln_score;
+        REQUIRE(mg94_marginal(seqs, aln_full, P) == 0);
+        REQUIRE(mg94_marginal_score_only(seqs, aln_score, P) == 0);
+        CHECK(aln_score.weight == aln_full.weight);
+        CHECK(aln_score.f.seq_data.empty());
+    }
+}
+
+TEST_CASE("[gotoh.cc] indel_params") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+    vector<string> seqs = {"CTCTGGATAGTG", "CTATAGTG"};
+
+    alignment_t aln_default, aln;
+    REQUIRE(mg94_marginal(seqs, aln_default, P) == 0);
+    REQUIRE(mg94_marginal(seqs, aln, P, indel_params_t()) == 0);
+    CHECK(aln.weight == aln_default.weight);
+
+    // rarer and shorter gaps make the 4 nucleotide deletion more costly
+    indel_params_t indel;
+    indel.insertion = indel.deletion = 0.0001;
+    indel.insertion_len = indel.deletion_len = 2.0;
+    alignment_t aln_gaps, aln_banded, aln_score;
+    REQUIRE(mg94_marginal(seqs, aln_gaps, P, indel) == 0);
+    CHECK(aln_gaps.weight > aln_default.weight);
+    CHECK(aln_gaps.f.seq_data[1] == "CT----ATAGTG");
+
+    // every kernel uses the same gap costs
+    band_t band;
+    REQUIRE(mg94_marginal_banded(seqs, aln_banded, P, band, 0, 0, indel) == 0);
+    CHECK(aln_banded.weight == aln_gaps.weight);
+    REQUIRE(mg94_marginal_score_only(seqs, aln_score, P, indel) == 0);
+    CHECK(aln_score.weight == aln_gaps.weight);
+}
+
+TEST_CASE("[gotoh.cc] gotoh_noframeshifts_score_only") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+
+    vector<vector<string>> pairs = {
+        {"CTCTGGATAGTG", "CTCTGGCCCATAGTG"},
+        {"CTCTGGATAGTG", "CTCTGG"},
+        {"ACGTTAAGGCCTACGTTAAGGCCTACGTTAAGGCCT",
+         "ACGTTAAGCCTTTACGTAAGGCTACGAAAGGCCTAA"},
+        {"ATGCCCAAATTTGGGCCCAAATTTGGGTGA", "ATGCCCAAAGGGCCCTTTAAATTTGGGTGA"}};
+
+    for(auto& seqs : pairs) {
+        alignment_t aln_full, aln_score;
+        REQUIRE(gotoh_noframeshifts(seqs, aln_full, P) == 0);
+        REQUIRE(gotoh_noframeshifts_score_only(seqs, aln_score, P) == 0);
+        CHECK(aln_score.weight == aln_full.weight);
+    }
+}
+
+TEST_CASE("[gotoh.cc] gotoh_noframeshifts") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+    alignment_t aln;
+
+    SUBCASE("codon deletion after the first nucleotide") {
+        // cells of the first columns (j < 3) ending in a deletion
+        vector<string> seqs = {"AGGGTTCCC", "ATTCCC"};
+        REQUIRE(gotoh_noframeshifts(seqs, aln, P) == 0);
+        CHECK(aln.f.seq_data[0] == "AGGGTTCCC");
+        CHECK(aln.f.seq_data[1] == "A---TTCCC");
+    }
+    SUBCASE("codon insertion") {
+        vector<string> seqs = {"CTCTGGATAGTG", "CTCTGGCCCATAGTG"};
+        REQUIRE(gotoh_noframeshifts(seqs, aln, P) == 0);
+        CHECK(aln.f.seq_data[0] == "CTCTGG---ATAGTG");
+        CHECK(aln.f.seq_data[1] == "CTCTGGCCCATAGTG");
+    }
+    SUBCASE("ties in the first codon rows") {
+        // with free gaps and emissions every path costs 0; as in the original
+        // kernel a match wins ties with an insertion in rows 1 and 2
+        struct zero_emission_t {
+            int rows() const { return 3; }
+            int cols() const { return 9; }
+            double match(int, int) const { return 0.0; }
+            double insertion(int) const { return 0.0; }
+        };
+        score_model_t model;
+        model.insertion = model.deletion = model.insertion_ext =
+            model.deletion_ext = model.no_insertion = model.no_deletion =
+                model.no_insertion_ext = model.no_deletion_ext = 0.0;
+        float inf = std::numeric_limits<float>::max();
+        Eigen::MatrixXf Dm = Eigen::MatrixXf::Constant(4, 10, inf);
+        Eigen::MatrixXf Pm = Eigen::MatrixXf::Constant(4, 10, inf);
+        Eigen::MatrixXf Qm = Eigen::MatrixXf::Constant(4, 10, inf);
+        Eigen::MatrixXi Bd = Eigen::MatrixXi::Constant(4, 10, -1);
+        Eigen::MatrixXi Bp = Bd, Bq = Bd;
+        codon_fill(model, zero_emission_t(), -3, 9, Dm, Pm, Qm, Bd, Bp,
+                   Bq);
+        for(int i = 1; i < 3; i++) {
+            for(int j = i + 3; j < 10; j += 3) {
+                CHECK(Pm(i, j) == Dm(i, j));
+                CHECK(Bd(i, j) == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("[gotoh.cc] mg94_marginal_linear") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+
+    vector<vector<string>> pairs = {
+        {"CTCTGGATAGTG", "CTATAGTG"},
+        {"CTCTGG", "CCTGG"},
+        {"GCGATTGCTGTT", "GCGACTGTT"},
+        {"ACGTTAAGGCCTACGTTAAGGCCTACGTTAAGGCCT",
+         "ACGTTAAGCCTTTACGTAAGGCTACGAAAGGCCTAA"},
+        {"ATGCCCAAATTTGGGCCCAAATTTGGGTGA", "ATGCCAAATGGGCCCAAAAATTTGGGTGA"}};
+
+    for(auto& seqs : pairs) {
+        alignment_t aln_full, aln_linear, aln_base;
+        REQUIRE(mg94_marginal(seqs, aln_full, P) == 0);
+        // force recursion with small blocks
+        REQUIRE(mg94_marginal_linear(seqs, aln_linear, P, 4) == 0);
+        REQUIRE(mg94_marginal_linear(seqs, aln_base, P) == 0);
+
+        CHECK(aln_linear.f.seq_data == aln_full.f.seq_data);
+        CHECK(aln_linear.weight == aln_full.weight);
+        CHECK(aln_base.f.seq_data == aln_full.f.seq_data);
+        CHECK(aln_base.weight == aln_full.weight);
+    }
+}
+
+TEST_CASE("[gotoh.cc] mg94_marginal_checkpoint") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+
+    vector<vector<string>> pairs = {
+        {"CTCTGGATAGTG", "CTATAGTG"},
+        {"CTCTGG", "CCTGG"},
+        {"GCGATTGCTGTT", "GCGACTGTT"},
+        {"ACGTTAAGGCCTACGTTAAGGCCTACGTTAAGGCCT",
+         "ACGTTAAGCCTTTACGTAAGGCTACGAAAGGCCTAA"},
+        {"ATGCCCAAATTTGGGCCCAAATTTGGGTGA", "ATGCCAAATGGGCCCAAAAATTTGGGTGA"}};
+
+    for(auto& seqs : pairs) {
+        alignment_t aln_full;
+        REQUIRE(mg94_marginal(seqs, aln_full, P) == 0);
+        for(int k : {0, 1, 2, 5, 1000}) {
+            alignment_t aln;
+            REQUIRE(mg94_marginal_checkpoint(seqs, aln, P, 0, k) == 0);
+            CHECK(aln.f.seq_data == aln_full.f.seq_data);
+            CHECK(aln.weight == aln_full.weight);
+        }
+    }
+}
+
+TEST_CASE("[gotoh.cc] checkpoint_interval") {
+    // least memory
+    CHECK(checkpoint_interval(10000, 10000, 0) == 400);
+    CHECK(checkpoint_interval(3, 3, 0) == 3);
+    // a larger budget allows larger intervals, up to a single block
+    int k = checkpoint_interval(10000, 10000, 50 << 20);
+    CHECK(k > 400);
+    CHECK(checkpoint_bytes(10000, 10000, k) <= (50 << 20));
+    CHECK(checkpoint_bytes(10000, 10000, 10000) > (50 << 20));
+    CHECK(checkpoint_interval(10000, 10000, size_t{1} << 40) == 10000);
+    // budget too small for any interval
+    CHECK(checkpoint_interval(10000, 10000, 1) == 400);
+}
+
+TEST_CASE("[gotoh.cc] mg94_marginal_scratch") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+    string scratch = boost::filesystem::temp_directory_path().string();
+
+    vector<vector<string>> pairs = {
+        {"CTCTGGATAGTG", "CTATAGTG"},
+        {"CTCTGGATAGTG", "CTCTGGGGATAGTG"},
+        {"ACGTTAAGGGGT", "ACGAAGGGGT"},
+        {"CCCCCCGGGGGGTTTTTTAAAAAA", "CCCGGTTTGGTTTTTTAAAAACCCCAA"}};
+
+    for(auto& seqs : pairs) {
+        alignment_t aln_full, aln_scratch;
+        REQUIRE(mg94_marginal(seqs, aln_full, P) == 0);
+        // max_memory only fits a single row of backtracking info
+        REQUIRE(mg94_marginal_scratch(seqs, aln_scratch, P, scratch, 0) == 0);
+        CHECK(aln_scratch.f.seq_data == aln_full.f.seq_data);
+        CHECK(aln_scratch.weight == aln_full.weight);
+    }
+}
+
+TEST_CASE("[gotoh.cc] mg94_marginal_banded") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+
+    vector<vector<string>> pairs = {
+        {"CTCTGGATAGTG", "CTATAGTG"},
+        {"ACGTTAAGGCCTACGTTAAGGCCTACGTTAAGGCCT",
+         "ACGTTAAGCCTTTACGTAAGGCTACGAAAGGCCTAA"},
+        {"ATGCCCAAATTTGGGCCCAAATTTGGGTGA", "ATGCCAAATGGGCCCAAAAATTTGGGTGA"}};
+
+    for(auto& seqs : pairs) {
+        alignment_t aln_full, aln_band, aln_narrow;
+        band_t band, narrow;
+        REQUIRE(mg94_marginal(seqs, aln_full, P) == 0);
+        REQUIRE(mg94_marginal_banded(seqs, aln_band, P, band) == 0);
+        // a narrow initial band is widened until the path fits inside
+        REQUIRE(mg94_marginal_banded(seqs, aln_narrow, P, narrow, 1) == 0);
+
+        CHECK(band.interior);
+        CHECK(aln_band.f.seq_data == aln_full.f.seq_data);
+        CHECK(aln_band.weight == aln_full.weight);
+
+        CHECK(narrow.interior);
+        CHECK(narrow.hi - narrow.lo > 2);
+        for(int s = 0; s < 2; s++) {
+            string ungapped = aln_narrow.f.seq_data[s];
+            boost::erase_all(ungapped, "-");
+            CHECK(ungapped == seqs[s]);
+        }
+
+        // band around the path of a previous alignment
+        alignment_t aln_warm;
+        band_t warm = alignment_band(aln_full, 3);
+        CHECK(warm.lo < 0);
+        CHECK(warm.hi > 0);
+        REQUIRE(mg94_marginal_banded(seqs, aln_warm, P, warm, -1) == 0);
+        CHECK(warm.interior);
+        CHECK(aln_warm.f.seq_data == aln_full.f.seq_data);
+        CHECK(aln_warm.weight == aln_full.weight);
+    }
+
+    // insertion then deletion of 12 nucleotides: the path leaves a narrow band,
+    // which max_memory does not allow to widen
+    vector<string> seqs = {"ATGAAACCCGGGTTTACGTTAGCCGATCGGATCCAGCCAGTA",
+                           "ATGAAACCCTAGCATGCAGCAGGGTTTACGTTAGCCCCAGTA"};
+    alignment_t aln_capped;
+    band_t capped;
+    REQUIRE(mg94_marginal_banded(seqs, aln_capped, P, capped, 1, 1) == 0);
+    CHECK_FALSE(capped.interior);
+    CHECK(capped.hi - capped.lo == 6);
+    for(int s = 0; s < 2; s++) {
+        string ungapped = aln_capped.f.seq_data[s];
+        boost::erase_all(ungapped, "-");
+        CHECK(ungapped == seqs[s]);
+    }
+    // without a limit the band is widened until the path fits inside
+    alignment_t aln_wide;
+    band_t wide;
+    REQUIRE(mg94_marginal_banded(seqs, aln_wide, P, wide, 1) == 0);
+    CHECK(wide.interior);
+    CHECK(wide.hi - wide.lo > 6);
+
+    // the path stays inside the band, but the best alignment leaves it
+    seqs = {"CTAATCTCTAACATCAGCGAGCGATAGACG", "ATCTAATCTCATAAGCCTGCACG"};
+    alignment_t aln_full, aln_inside;
+    band_t inside;
+    REQUIRE(mg94_marginal(seqs, aln_full, P) == 0);
+    REQUIRE(mg94_marginal_banded(seqs, aln_inside, P, inside, 1) == 0);
+    CHECK(inside.interior);
+    CHECK(alignment_band(aln_full, 0).lo < inside.lo);
+    CHECK(aln_inside.weight > aln_full.weight);
+
+    // a given band that misses the last cell is widened to contain it
+    seqs = {"ATGAAACCCGGGTTTACGTTAGCCGATCGGATC",
+            "ATGAAACCCGGGAAATTTACGTTAGCCGATCGGATCCAGCCAGCC"};
+    alignment_t aln_given, aln_ref;
+    band_t given;
+    REQUIRE(mg94_marginal_banded(seqs, aln_given, P, given, -1) == 0);
+    CHECK(given.lo <= 0);
+    CHECK(given.hi >= 12);
+    REQUIRE(mg94_marginal(seqs, aln_ref, P) == 0);
+    CHECK(aln_given.f.seq_data == aln_ref.f.seq_data);
+}
+
+TEST_CASE("[gotoh.cc] gotoh_noframeshifts_banded") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+    vector<string> seqs = {"GCGATTGCTGTT", "GCGACTGTT"};
+
+    alignment_t aln_full, aln_band;
+    band_t band;
+    REQUIRE(gotoh_noframeshifts(seqs, aln_full, P) == 0);
+    REQUIRE(gotoh_noframeshifts_banded(seqs, aln_band, P, band, 3) == 0);
+
+    CHECK(band.interior);
+    CHECK(aln_band.f.seq_data == aln_full.f.seq_data);
+    CHECK(aln_band.weight == aln_full.weight);
+
+    // a given band that misses the last cell is widened to contain it
+    seqs = {"GCGATTGCT", "GCGATTGCTGTTACGTTAGCC"};
+    alignment_t aln_given;
+    band_t given;
+    REQUIRE(gotoh_noframeshifts_banded(seqs, aln_given, P, given, -1) == 0);
+    CHECK(given.hi >= 12);
+    CHECK(aln_given.f.seq_data[0] == "GCGATTGCT------------");
+    CHECK(aln_given.f.seq_data[1] == seqs[1]);
+}
+
+TEST_CASE("[gotoh.cc] estimate_band") {
+    string a = "ATGCCCAAATTTGGGCCCAAATTTGGGTGAACGTTAAGGCCTACGTTAAGGCCT";
+    string b = "CCCATGCCCAAATTTGGGCCCAAATTTGGGTGAACGTTAAGGCCTACGTTAAGGCCT";
+    int lo, hi;
+    estimate_band(a, b, lo, hi);
+    CHECK(lo <= 0);
+    CHECK(hi >= 3);  // three nucleotide insertion at the start
+    CHECK(lo >= -static_cast<int>(a.length()));
+    CHECK(hi <= static_cast<int>(b.length()));
+}
@@ -0,0 +1,118 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <coati/isa.hpp>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+std::atomic<int> active{-1};  // isa_t, or -1 before the first use
+}  // namespace
+
+isa_t detect_isa() {
+#if defined(__x86_64__) || defined(__i386__)
+    // also checks that the OS saves the vector registers (xgetbv)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) {
+        return isa_t::avx512;
+    }
+    if(__builtin_cpu_supports("avx2")) {
+        return isa_t::avx2;
+    }
+#endif
+    return isa_t::sse2;
+}
+
+isa_t active_isa() {
+    int isa = active.load(std::memory_order_relaxed);
+    if(isa != -1) {
+        return static_cast<isa_t>(isa);
+    }
+
+    isa_t chosen = std::min(detect_isa(), isa_t::avx2);
+    const char* name = std::getenv("COATI_ISA");
+    if(name != nullptr && *name != '\0') {
+        if(!parse_isa(name, chosen)) {
+            std::cerr << "Unknown instruction set '" << name
+                      << "' in COATI_ISA (sse2, avx2, avx512). Exiting!"
+                      << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        if(chosen > detect_isa()) {
+            std::cerr << "Instruction set '" << name
+                      << "' in COATI_ISA is not supported by this CPU. Exiting!"
+                      << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    active.store(static_cast<int>(chosen), std::memory_order_relaxed);
+    return chosen;
+}
+
+bool set_active_isa(isa_t isa) {
+    if(isa > detect_isa()) {
+        return false;
+    }
+    active.store(static_cast<int>(isa), std::memory_order_relaxed);
+    return true;
+}
+
+const char* isa_name(isa_t isa) {
+    switch(isa) {
+    case isa_t::avx512:
+        return "avx512";
+    case isa_t::avx2:
+        return "avx2";
+    default:
+        return "sse2";
+    }
+}
+
+bool parse_isa(const std::string& name, isa_t& isa) {
+    for(isa_t x : {isa_t::sse2, isa_t::avx2, isa_t::avx512}) {
+        if(name == isa_name(x)) {
+            isa = x;
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST_CASE("[isa.cc] active_isa") {
+    isa_t isa = isa_t::sse2;
+    CHECK(parse_isa("avx2", isa));
+    CHECK(isa == isa_t::avx2);
+    CHECK_FALSE(parse_isa("neon", isa));
+    CHECK(isa == isa_t::avx2);
+
+    isa_t best = detect_isa(), current = active_isa();
+    CHECK(current <= best);
+    CHECK(set_active_isa(isa_t::sse2));
+    CHECK(active_isa() == isa_t::sse2);
+    CHECK(set_active_isa(best));
+    CHECK(active_isa() == best);
+    set_active_isa(current);
+}
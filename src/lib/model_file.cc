@@ -0,0 +1,204 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#include <doctest/doctest.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <cerrno>
+#include <coati/model_file.hpp>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+const char model_magic[8] = {'C', 'O', 'A', 'T', 'I', 'M', 'D', 'L'};
+constexpr size_t model_bytes =
+    sizeof(model_file_t::header_t) + sizeof(model_file_t::payload_t);
+}  // namespace
+
+model_file_t::model_file_t(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd == -1) {
+        throw std::runtime_error("Opening model file '" + path +
+                                 "' failed: " + std::strerror(errno));
+    }
+    // header first, so that files of other versions are reported as such
+    header_t header;
+    if(pread(fd, &header, sizeof(header), 0) !=
+           static_cast<ssize_t>(sizeof(header)) ||
+       std::memcmp(header.magic, model_magic, sizeof(model_magic)) != 0) {
+        close(fd);
+        throw std::runtime_error("'" + path + "' is not a model file");
+    }
+    if(header.version != version) {
+        close(fd);
+        throw std::runtime_error("'" + path +
+                                 "' is not a model file of this version");
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != model_bytes) {
+        close(fd);
+        throw std::runtime_error("Model file '" + path + "' is corrupted");
+    }
+    map_ = mmap(nullptr, model_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd);  // the mapping stays valid
+    if(map_ == MAP_FAILED) {
+        map_ = nullptr;
+        throw std::runtime_error("Mapping model file '" + path +
+                                 "' failed: " + std::strerror(err));
+    }
+
+    payload_ = reinterpret_cast<const payload_t*>(
+        static_cast<const header_t*>(map_) + 1);
+    if(header.checksum != checksum(*payload_)) {
+        munmap(map_, model_bytes);
+        throw std::runtime_error("Model file '" + path + "' is corrupted");
+    }
+}
+
+model_file_t::~model_file_t() {
+    if(map_ != nullptr) munmap(map_, model_bytes);
+}
+
+bool model_file_t::is_model_file(const std::string& path) {
+    char magic[sizeof(model_magic)] = {};
+    ifstream in(path, ios::binary);
+    in.read(magic, sizeof(magic));
+    return in.good() && std::memcmp(magic, model_magic, sizeof(magic)) == 0;
+}
+
+/* 64-bit FNV-1a hash of the payload bytes */
+uint64_t model_file_t::checksum(const payload_t& payload) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(&payload);
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t k = 0; k < sizeof(payload); k++) {
+        hash = (hash ^ bytes[k]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Compile the rate matrix and branch length of a CSV file (see
+ * parse_matrix_csv) into model file out_file */
+int compile_model(const std::string& csv_file, const std::string& out_file) {
+    Matrix64f Q;
+    double t = 0.0;
+    if(parse_matrix_csv(csv_file, Q, t) != 0) {
+        return EXIT_FAILURE;
+    }
+    if(t <= 0) {
+        cerr << "Branch length must be positive. Exiting!" << endl;
+        return EXIT_FAILURE;
+    }
+
+    auto payload = std::make_unique<model_file_t::payload_t>();
+    payload->t = t;
+    Eigen::Map<Matrix64f>(payload->Q) = Q;
+    Matrix64f P = (Q * t).exp();
+    Eigen::Map<Matrix64f>(payload->P) = P;
+
+    model_file_t::header_t header{};
+    std::memcpy(header.magic, model_magic, sizeof(model_magic));
+    header.version = model_file_t::version;
+    header.checksum = model_file_t::checksum(*payload);
+
+    ofstream out(out_file, ios::binary | ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(payload.get()), sizeof(*payload));
+    out.close();
+    if(!out) {
+        cerr << "Error writing model file '" << out_file << "'. Exiting!"
+             << endl;
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+TEST_CASE("[model_file.cc] compile_model") {
+    // MG94 rates as a CSV file
+    Matrix64f Q;
+    mg94_q(Q);
+    std::string csv = "model-test.csv", bin = "model-test.bin";
+    {
+        const char nucs[] = "ACGT";
+        ofstream out(csv);
+        out.precision(17);
+        out << 0.02 << "\n";
+        for(int i = 0; i < 64; i++) {
+            for(int j = 0; j < 64; j++) {
+                out << nucs[i >> 4] << nucs[(i >> 2) & 3] << nucs[i & 3] << ","
+                    << nucs[j >> 4] << nucs[(j >> 2) & 3] << nucs[j & 3] << ","
+                    << Q(i, j) << "\n";
+            }
+        }
+    }
+    REQUIRE(compile_model(csv, bin) == 0);
+    CHECK(model_file_t::is_model_file(bin));
+    CHECK_FALSE(model_file_t::is_model_file(csv));
+
+    {
+        model_file_t model(bin);
+        Matrix64f P;
+        mg94_p(P, 0.02);
+        CHECK(model.t() == 0.02);
+        CHECK(model.Q() == Q);
+        CHECK(model.P() == P);
+    }
+
+    SUBCASE("corrupted") {
+        std::fstream f(bin, ios::in | ios::out | ios::binary);
+        f.seekp(static_cast<std::streamoff>(model_bytes) - 1);
+        f.put('\x7f');
+        f.close();
+        CHECK_THROWS_AS(model_file_t{bin}, std::runtime_error);
+    }
+    SUBCASE("other version") {
+        std::fstream f(bin, ios::in | ios::out | ios::binary);
+        model_file_t::header_t header;
+        f.read(reinterpret_cast<char*>(&header), sizeof(header));
+        header.version = model_file_t::version + 1;
+        f.seekp(0);
+        f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        f.close();
+        string error;
+        try {
+            model_file_t model(bin);
+        } catch(const std::runtime_error& e) {
+            error = e.what();
+        }
+        CHECK(error.find("of this version") != string::npos);
+    }
+    SUBCASE("truncated") {
+        boost::filesystem::resize_file(bin, model_bytes - 8);
+        CHECK_THROWS_AS(model_file_t{bin}, std::runtime_error);
+    }
+    SUBCASE("missing") {
+        CHECK_THROWS_AS(model_file_t{"model-test.missing"}, std::runtime_error);
+        CHECK_THROWS_AS(model_file_t{csv}, std::runtime_error);
+    }
+
+    boost::filesystem::remove(csv);
+    boost::filesystem::remove(bin);
+}
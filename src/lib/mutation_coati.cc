@@ -280,14 +280,17 @@ TEST_CASE("[mutation_coati.cc] mg94_q") {
 
 /* Muse & Gaut Model (1994) P matrix given rate matrix and branch lenght */
 void mg94_p(Matrix64f& P, const double& brlen) {
-    Matrix64f Q;
-    mg94_q(Q);
-
     if(brlen <= 0) {
         cout << "Branch length must be positive." << endl;
         exit(EXIT_FAILURE);
     }
+    if(brlen == mg94_default_brlen) {
+        P = Eigen::Map<const Matrix64f>(mg94_default_P);
+        return;
+    }
 
+    Matrix64f Q;
+    mg94_q(Q);
     Q = Q * brlen;
     P = Q.exp();
 }
@@ -1145,7 +1148,13 @@ TEST_CASE("[mutation_coati.cc] mg94_p") {
 }
 
 /* Create marginal Muse and Gaut codon model P matrix*/
-void mg94_marginal_p(Eigen::Tensor<double, 3>& p, Matrix64f& P) {
+void mg94_marginal_p(Eigen::Tensor<double, 3>& p, const Matrix64f& P) {
+    // default model, marginalized at build time
+    if(std::equal(P.data(), P.data() + P.size(), mg94_default_P)) {
+        std::copy(mg94_default_p, mg94_default_p + p.size(), p.data());
+        return;
+    }
+
     double marg;
 
     for(int cod = 0; cod < 64; cod++) {
@@ -1178,6 +1187,31 @@ void mg94_marginal_p(Eigen::Tensor<double, 3>& p, Matrix64f& P) {
     }
 }
 
+TEST_CASE("[mutation_coati.cc] default_tables") {
+    // tables are the same as computing the default model
+    Matrix64f Q, P;
+    mg94_q(Q);
+    Q = Q * mg94_default_brlen;
+    P = Q.exp();
+    Matrix64f P_table;
+    mg94_p(P_table, mg94_default_brlen);
+    CHECK(P_table == P);
+
+    // a P matrix that differs in codon 0 only is marginalized at run time
+    Eigen::Tensor<double, 3> p(64, 3, 4), p_table(64, 3, 4);
+    Matrix64f P_other = P;
+    P_other(0, 0) = std::nextafter(P(0, 0), 1.0);
+    mg94_marginal_p(p, P_other);
+    mg94_marginal_p(p_table, P);
+    for(int cod = 1; cod < 64; cod++) {
+        for(int pos = 0; pos < 3; pos++) {
+            for(int nuc = 0; nuc < 4; nuc++) {
+                CHECK(p_table(cod, pos, nuc) == p(cod, pos, nuc));
+            }
+        }
+    }
+}
+
 TEST_CASE("[mutation_coati.cc] mg94_marginal_p") {
     Eigen::Tensor<double, 3> p(64, 3, 4);
     Matrix64f P;
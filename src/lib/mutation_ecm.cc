@@ -738,9 +738,9 @@ TEST_CASE("[mutation_coati.cc] k") {
     CHECK(k(22, 19, 2) == kappa * kappa);  // CCG -> CAT, ECM+F+omega+1k(tv)
 }
 
-/* Empirical Codon Model P matrix */
-void ecm_p(Matrix64f& P, const double& br_len) {
-    Matrix64f Q = Matrix64f::Zero();
+/* Empirical Codon Model Q matrix */
+void ecm_q(Matrix64f& Q) {
+    Q = Matrix64f::Zero();
 
     double d = 0.0;
 
@@ -763,6 +763,12 @@ void ecm_p(Matrix64f& P, const double& br_len) {
 
     // normalize
     Q = Q / d;
+}
+
+/* Empirical Codon Model P matrix */
+void ecm_p(Matrix64f& P, const double& br_len) {
+    Matrix64f Q;
+    ecm_q(Q);
 
     // P matrix
     Q = Q * br_len;
@@ -155,9 +155,11 @@ TEST_CASE("[mutation_fst.cc] nuc2pos") {
 }
 
 /* Create affine gap indel model FST*/
-void indel(VectorFst<StdArc>& indel_model, string model) {
-    double deletion = 0.001, insertion = 0.001;
-    double deletion_ext = 1.0 - 1.0 / 6.0, insertion_ext = 1.0 - 1.0 / 6.0;
+void indel(VectorFst<StdArc>& indel_model, string model,
+           const indel_params_t& params) {
+    double deletion = params.deletion, insertion = params.insertion;
+    double deletion_ext = 1.0 - 1.0 / params.deletion_len;
+    double insertion_ext = 1.0 - 1.0 / params.insertion_len;
     double nuc_freqs[2][4] = {{0.308, 0.185, 0.199, 0.308},
                               {0.2676350, 0.2357727, 0.2539630, 0.2426323}};
     int m = model.compare("ecm") == 0 ? 1 : 0;
@@ -0,0 +1,143 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#include <doctest/doctest.h>
+
+#include <coati/mutation_ecm.hpp>
+#include <coati/p_engine.hpp>
+
+p_engine_t::p_engine_t(const Matrix64f& Q, double bucket) : bucket_{bucket} {
+    Eigen::EigenSolver<Matrix64f> solver(Q);
+    clambda_ = solver.eigenvalues();
+    cV_ = solver.eigenvectors();
+    real_ = clambda_.imag().isZero(0.0) && cV_.imag().isZero(0.0);
+    if(real_) {
+        lambda_ = clambda_.real();
+        V_ = cV_.real();
+        V_inv_ = V_.inverse();
+    } else {
+        cV_inv_ = cV_.inverse();
+    }
+}
+
+void p_engine_t::p(double t, Matrix64f& P) const {
+    if(t <= 0) {
+        cerr << "Branch length must be positive." << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if(real_) {
+        Vector64f e = (lambda_ * t).array().exp();
+        P.noalias() = V_ * e.asDiagonal() * V_inv_;
+    } else {
+        Vector64c e = (clambda_ * t).array().exp();
+        P = (cV_ * e.asDiagonal() * cV_inv_).real();
+    }
+    P = P.cwiseMax(0.0);
+}
+
+void p_engine_t::derivatives(double t, Matrix64f& dP, Matrix64f& d2P) const {
+    // dP/dt = V diag(lambda exp(lambda t)) V^-1 and
+    // d2P/dt2 = V diag(lambda^2 exp(lambda t)) V^-1
+    if(real_) {
+        Vector64f d = lambda_.array() * (lambda_ * t).array().exp();
+        dP.noalias() = V_ * d.asDiagonal() * V_inv_;
+        d = lambda_.array() * d.array();
+        d2P.noalias() = V_ * d.asDiagonal() * V_inv_;
+    } else {
+        Vector64c d = clambda_.array() * (clambda_ * t).array().exp();
+        dP = (cV_ * d.asDiagonal() * cV_inv_).real();
+        d = clambda_.array() * d.array();
+        d2P = (cV_ * d.asDiagonal() * cV_inv_).real();
+    }
+}
+
+p_engine_t::entry_t& p_engine_t::lookup(double t) {
+    if(bucket_ > 0) {
+        t = std::max(std::round(t / bucket_), 1.0) * bucket_;
+    }
+    auto it = cache_.find(t);
+    if(it == cache_.end()) {
+        it = cache_.emplace(t, entry_t()).first;
+        p(t, it->second.P);
+    }
+    return it->second;
+}
+
+const Matrix64f& p_engine_t::p(double t) { return lookup(t).P; }
+
+const Eigen::Tensor<double, 3>& p_engine_t::marginal_p(double t) {
+    entry_t& entry = lookup(t);
+    if(entry.p.size() == 0) {
+        entry.p.resize(64, 3, 4);
+        mg94_marginal_p(entry.p, entry.P);
+    }
+    return entry.p;
+}
+
+TEST_CASE("[p_engine.cc] p_engine_t") {
+    Matrix64f Q, P, P_exp;
+
+    SUBCASE("mg94") { mg94_q(Q); }
+    SUBCASE("ecm") { ecm_q(Q); }
+
+    p_engine_t engine(Q);
+    for(double t : {0.0001, 0.0133, 0.1, 1.0, 5.0}) {
+        P_exp = (Q * t).exp();
+        engine.p(t, P);
+        CHECK((P - P_exp).cwiseAbs().maxCoeff() < 1e-12);
+        CHECK(P.minCoeff() >= 0.0);
+    }
+
+    // cached matrices and marginal tensors
+    const Matrix64f& P1 = engine.p(0.0133);
+    CHECK(&engine.p(0.0133) == &P1);
+    CHECK(engine.cached() == 1);
+    P_exp = (Q * 0.0133).exp();
+    Eigen::Tensor<double, 3> p(64, 3, 4), p_exp(64, 3, 4);
+    mg94_marginal_p(p_exp, P_exp);
+    p = engine.marginal_p(0.0133);
+    CHECK(engine.cached() == 1);
+    for(int cod = 0; cod < 64; cod++) {
+        for(int pos = 0; pos < 3; pos++) {
+            for(int nuc = 0; nuc < 4; nuc++) {
+                CHECK(p(cod, pos, nuc) ==
+                      doctest::Approx(p_exp(cod, pos, nuc)).epsilon(1e-12));
+            }
+        }
+    }
+
+    // derivatives against central differences
+    Matrix64f dP, d2P, P_lo, P_hi;
+    double h = 1e-5;
+    engine.derivatives(0.1, dP, d2P);
+    P_lo = (Q * (0.1 - h)).exp();
+    P_hi = (Q * (0.1 + h)).exp();
+    CHECK((dP - (P_hi - P_lo) / (2 * h)).cwiseAbs().maxCoeff() < 1e-8);
+    CHECK((Q * dP - d2P).cwiseAbs().maxCoeff() < 1e-12);
+
+    // branch lengths in the same bucket share an entry
+    p_engine_t bucketed(Q, 1e-6);
+    CHECK(&bucketed.p(0.0133) == &bucketed.p(0.0133004));
+    CHECK(&bucketed.p(0.0133) != &bucketed.p(0.0133006));
+    CHECK(bucketed.cached() == 2);
+}
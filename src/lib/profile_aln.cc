@@ -97,11 +97,12 @@ TEST_CASE("[utils.cc] create_profile") {
     }
 }
 
-/* Return value for  */
-double transition(Matrix4x3d cod, int pos, Vector4d nuc,
-                  const Eigen::Tensor<double, 3>& p) {
-    double val = 0;
-    pos = pos == 0 ? 2 : --pos;
+/* Weight of each nucleotide at position pos of a profile codon, i.e.
+ * transition() for a one-hot nuc. */
+Vector4d transition_weights(Matrix4x3d cod, int pos,
+                            const Eigen::Tensor<double, 3>& p) {
+    Vector4d val = Vector4d::Zero();
+    pos = pos == 0 ? 2 : pos - 1;
 
     // find highest value nucleotide per codon position
     Eigen::VectorXd::Index max_pos0, max_pos1, max_pos2;
@@ -109,14 +110,6 @@ double transition(Matrix4x3d cod, int pos, Vector4d nuc,
     double max_cod1 = cod.col(1).maxCoeff(&max_pos1);
     double max_cod2 = cod.col(2).maxCoeff(&max_pos2);
 
-    // codon to int value (AAA->0, AAC->1, ... TTT-> 63)
-    int cod_index = (max_pos0 << 4) + (max_pos1 << 2) + max_pos2;
-
-    // weighted average for each nuc freq with highest codon
-    for(int i = 0; i < 4; i++) {
-        val += max_cod0 * max_cod1 * max_cod2 * nuc[i] * p(cod_index, pos, i);
-    }
-
     // get second highest nuc value per codon position
     cod.col(0)(max_pos0) = -1;
     cod.col(1)(max_pos1) = -1;
@@ -126,27 +119,32 @@ double transition(Matrix4x3d cod, int pos, Vector4d nuc,
     double max2_cod1 = cod.col(1).maxCoeff(&max2_pos1);
     double max2_cod2 = cod.col(2).maxCoeff(&max2_pos2);
 
-    // codon: 2nd highest nuc, highest nuc, highest nuc
-    cod_index = (max2_pos0 << 4) + (max_pos1 << 2) + max_pos2;
-    for(int i = 0; i < 4; i++) {
-        val += max2_cod0 * max_cod1 * max_cod2 * nuc[i] * p(cod_index, pos, i);
-    }
-
-    // codon: highest nuc, 2nd highest nuc, highest nuc
-    cod_index = (max_pos0 << 4) + (max2_pos1 << 2) + max_pos2;
-    for(int i = 0; i < 4; i++) {
-        val += max_cod0 * max2_cod1 * max_cod2 * nuc[i] * p(cod_index, pos, i);
-    }
-
-    // codon: highest nuc, highest nuc, 2nd highest nuc
-    cod_index = (max_pos0 << 4) + (max_pos1 << 2) + max2_pos2;
-    for(int i = 0; i < 4; i++) {
-        val += max_cod0 * max_cod1 * max2_cod2 * nuc[i] * p(cod_index, pos, i);
+    // weighted average over the highest codon and the three codons with one
+    // 2nd highest nuc
+    Eigen::Index cod_index[4] = {
+        (max_pos0 << 4) + (max_pos1 << 2) + max_pos2,
+        (max2_pos0 << 4) + (max_pos1 << 2) + max_pos2,
+        (max_pos0 << 4) + (max2_pos1 << 2) + max_pos2,
+        (max_pos0 << 4) + (max_pos1 << 2) + max2_pos2};
+    double weight[4] = {max_cod0 * max_cod1 * max_cod2,
+                        max2_cod0 * max_cod1 * max_cod2,
+                        max_cod0 * max2_cod1 * max_cod2,
+                        max_cod0 * max_cod1 * max2_cod2};
+    for(int k = 0; k < 4; k++) {
+        for(int i = 0; i < 4; i++) {
+            val[i] += weight[k] * p(cod_index[k], pos, i);
+        }
     }
 
     return val;
 }
 
+/* Return value for  */
+double transition(Matrix4x3d cod, int pos, Vector4d nuc,
+                  const Eigen::Tensor<double, 3>& p) {
+    return transition_weights(cod, pos, p).dot(nuc);
+}
+
 TEST_CASE("[profile_aln.cc] transition") {
     Vector4d nuc;
     Matrix4x3d cod;
@@ -194,12 +192,100 @@ TEST_CASE("[profile_aln.cc] transition") {
         CHECK(transition(cod, 1, nuc, p) == doctest::Approx(0.05244));
         CHECK(transition(cod, 2, nuc, p) == doctest::Approx(0.04964));
     }
+
+    SUBCASE("transition_weights") {
+        cod << 0.3, 0.2, 0.3, 0.4, 0.2, 0.1, 0.2, 0.5, 0.2, 0.1, 0.1, 0.4;
+        for(int pos = 0; pos < 3; pos++) {
+            Vector4d w = transition_weights(cod, pos, p);
+            for(int i = 0; i < 4; i++) {
+                nuc = Vector4d::Unit(i);
+                CHECK(w.dot(nuc) == transition(cod, pos, nuc, p));
+            }
+            nuc << 0.3, 0.2, 0.2, 0.3;
+            CHECK(w.dot(nuc) == doctest::Approx(transition(cod, pos, nuc, p)));
+        }
+    }
+}
+
+namespace {
+/* Emission policy of the DP kernels (see gotoh_kernels.hpp) for aligning
+ * profile matrices: the expected cost of each column of pro2 at every position
+ * of pro1, and the background cost of each column of pro2 */
+class profile_emission_t {
+   public:
+    profile_emission_t(const Eigen::MatrixXd& pro1,
+                       const Eigen::MatrixXd& pro2,
+                       const Eigen::Tensor<double, 3>& p,
+                       const score_model_t& model)
+        : pro2_(pro2), emission_(4, pro1.cols() + 1), freq_(pro2.cols() + 1) {
+        int m = pro1.cols();
+        int n = pro2.cols();
+
+        Vector5d nuc_freqs;
+        for(int b = 0; b < 5; b++) {
+            nuc_freqs(b) = -model.nuc_freqs[b];
+        }
+        // background weight of each column of pro2 (inserted bases)
+        for(int j = 1; j < n + 1; j++) {
+            freq_(j) = -nuc_pi(pro2.col(j - 1), nuc_freqs);
+        }
+        // emission weights of each nucleotide for every position of pro1
+        for(int i = 1; i < m + 1; i++) {
+            Matrix4x3d codon = pro1.block(0, (((i - 1) / 3) * 3), 4, 3);
+            emission_.col(i) = transition_weights(codon, i % 3, p);
+        }
+    }
+
+    int rows() const { return static_cast<int>(emission_.cols()) - 1; }
+    int cols() const { return static_cast<int>(pro2_.cols()); }
+    double match(int i, int j) const {
+        return -log(pro2_.col(j - 1).dot(emission_.col(i)));
+    }
+    double insertion(int j) const { return freq_(j); }
+
+   private:
+    const Eigen::MatrixXd& pro2_;
+    Eigen::MatrixXd emission_;
+    Eigen::VectorXd freq_;
+};
+}  // namespace
+
+/* Fill marginal MG94 DP matrices for aligning profile matrices. With more
+ * than one thread the matrices are filled in tiles (see wavefront), which
+ * requires full matrices. */
+template <class FMatrix, class BMatrix>
+void gotoh_profile_fill(const Eigen::MatrixXd& pro1,
+                        const Eigen::MatrixXd& pro2,
+                        const Eigen::Tensor<double, 3>& p,
+                        const indel_params_t& indel, FMatrix& D, FMatrix& P,
+                        FMatrix& Q, BMatrix& Bd, BMatrix& Bp, BMatrix& Bq,
+                        int threads = 1) {
+    int m = pro1.cols();
+    int n = pro2.cols();
+
+    score_model_t model(indel);
+    profile_emission_t em(pro1, pro2, p, model);
+
+    if(threads <= 1) {
+        frameshift_gaps_t::fill(model, em, -m, n, D, P, Q, Bd, Bp, Bq);
+        return;
+    }
+    frameshift_fill_border(model, em, -m, n, D, P, Q, Bd, Bp, Bq);
+    wavefront(wavefront_tiles(m), wavefront_tiles(n), threads,
+              [&](int r, int c) {
+                  frameshift_fill_block(
+                      model, em, r * wavefront_tile + 1,
+                      min(m, (r + 1) * wavefront_tile),
+                      c * wavefront_tile + 1, min(n, (c + 1) * wavefront_tile),
+                      -m, n, D, P, Q, Bd, Bp, Bq);
+              });
 }
 
 /* Gotoh dynamic programming alignment with marginal Muse & Gaut p matrix for
- * profile matrices  */
+ * profile matrices, filled using up to threads threads */
 int gotoh_profile_marginal(vector<string> seqs1, vector<string> seqs2,
-                           alignment_t& aln, Matrix64f& P_m) {
+                           alignment_t& aln, Matrix64f& P_m, int threads,
+                           const indel_params_t& indel) {
     // P matrix for marginal Muse and Gaut codon model
     Eigen::Tensor<double, 3> p(64, 3, 4);
     mg94_marginal_p(p, P_m);
@@ -210,10 +296,8 @@ int gotoh_profile_marginal(vector<string> seqs1, vector<string> seqs2,
     int m = pro1.cols();
     int n = pro2.cols();
 
-    // assert that length of 1st sequence (ref) is multiple of 3
-    if(m % 3 != 0) {
-        cout << "Reference CDS length must be of length multiple of 3" << endl;
-        exit(EXIT_FAILURE);
+    if(check_codon_lengths(seqs1) != 0) {
+        return EXIT_FAILURE;
     }
 
     // DP matrices for match/mismatch (D), insertion (P), deletion (Q)
@@ -224,132 +308,56 @@ int gotoh_profile_marginal(vector<string> seqs1, vector<string> seqs2,
     Eigen::MatrixXf Q = Eigen::MatrixXf::Constant(
         m + 1, n + 1, std::numeric_limits<float>::max());
 
-    // backtracking info matrices for match/mismatch (Bd), insert (Bp), and
+    // backtracking info for match/mismatch (Bd), insert (Bp), and
     // deletion (Bq)
-    Eigen::MatrixXi Bd = Eigen::MatrixXi::Constant(m + 1, n + 1, -1);
-    Eigen::MatrixXi Bp = Eigen::MatrixXi::Constant(m + 1, n + 1, -1);
-    Eigen::MatrixXi Bq = Eigen::MatrixXi::Constant(m + 1, n + 1, -1);
-
-    double insertion = log(0.001);
-    double deletion = log(0.001);
-    double insertion_ext = log(1.0 - (1.0 / 6.0));
-    double deletion_ext = log(1.0 - (1.0 / 6.0));
-    double no_insertion = log(1.0 - 0.001);
-    double no_deletion = log(1.0 - 0.001);
-    double no_insertion_ext = log(1.0 / 6.0);
-    double no_deletion_ext = log(1.0 / 6.0);
-
-    Vector5d nuc_freqs;
-    nuc_freqs << log(0.308), log(0.185), log(0.199), log(0.308), log(0.25);
-
-    // DP and backtracking matrices initialization
-
-    // fill first values on D that are independent
-    D(0, 0) = 0.0;  // 0.0;
-    Bd(0, 0) = 0;
-    D(0, 1) = -insertion - nuc_pi(pro2.col(0), nuc_freqs) - no_insertion_ext;
-    P(0, 1) = -insertion - nuc_pi(pro2.col(0), nuc_freqs) - no_insertion_ext;
-    Bd(0, 1) = 1;
-    Bp(0, 1) = 2;
-    D(1, 0) = -no_insertion - deletion - no_deletion_ext;
-    Q(1, 0) = -no_insertion - deletion - no_deletion_ext;
-    Bd(1, 0) = 2;
-    Bq(1, 0) = 2;
-
-    // fill first row of D
-    if(n + 1 >= 2) {
-        for(int j = 2; j < n + 1; j++) {
-            D(0, j) = D(0, j - 1) - insertion_ext -
-                      nuc_pi(pro2.col(j - 1), nuc_freqs);
-            P(0, j) = P(0, j - 1) - insertion_ext -
-                      nuc_pi(pro2.col(j - 1), nuc_freqs);
-            Bd(0, j) = 1;
-            Bp(0, j) = 1;
-        }
-    }
+    traceback_t B(m + 1, n + 1);
+    auto Bd = B.d();
+    auto Bp = B.p();
+    auto Bq = B.q();
 
-    // fill first column of D
-    if(m + 1 >= 2) {
-        for(int i = 2; i < m + 1; i++) {
-            D(i, 0) = D(i - 1, 0) - deletion_ext;
-            Q(i, 0) = Q(i - 1, 0) - deletion_ext;
-            Bd(i, 0) = 2;
-            Bq(i, 0) = 1;
-        }
-    }
+    gotoh_profile_fill(pro1, pro2, p, indel, D, P, Q, Bd, Bp, Bq, threads);
 
-    Matrix4x3d codon;
-    double p1, p2, q1, q2, d;
+    aln.weight += D(m, n);  // weight
 
-    for(int i = 1; i < m + 1; i++) {
-        // codon = seq_a.substr((((i-1)/3)*3),3); // current codon
-        codon = pro1.block(0, (((i - 1) / 3) * 3), 4, 3);  // 3x3
-        for(int j = 1; j < n + 1; j++) {
-            // insertion
-            p1 = P(i, j - 1) - insertion_ext -
-                 nuc_pi(pro2.col(j - 1), nuc_freqs);
-            p2 = Bd(i, j - 1) == 0
-                     ? D(i, j - 1) - insertion -
-                           nuc_pi(pro2.col(j - 1), nuc_freqs) - no_insertion_ext
-                 : Bd(i, j - 1) == 1 ? D(i, j - 1) - insertion_ext -
-                                           nuc_pi(pro2.col(j - 1), nuc_freqs)
-                                     : numeric_limits<double>::max();
-            P(i, j) = min(p1, p2);
-            Bp(i, j) =
-                p1 < p2
-                    ? 1
-                    : 2;  // 1 is insertion extension, 2 is insertion opening
-
-            // deletion
-            q1 = Q(i - 1, j) - deletion_ext;
-            q2 = Bd(i - 1, j) == 0
-                     ? D(i - 1, j) - no_insertion - deletion - no_deletion_ext
-                 : Bd(i - 1, j) == 1 ? D(i - 1, j) - no_deletion_ext - deletion
-                                     : D(i - 1, j) - deletion_ext;
-            Q(i, j) = min(q1, q2);
-            Bq(i, j) =
-                q1 < q2 ? 1
-                        : 2;  // 1 is deletion extension, 2 is deletion opening
-
-            // match/mismatch
-            if(Bd(i - 1, j - 1) == 0) {
-                d = D(i - 1, j - 1) - no_insertion - no_deletion -
-                    log(transition(codon, (i) % 3, pro2.col(j - 1), p));
-            } else if(Bd(i - 1, j - 1) == 1) {
-                d = D(i - 1, j - 1) - no_deletion -
-                    log(transition(codon, (i) % 3, pro2.col(j - 1), p));
-            } else {
-                d = D(i - 1, j - 1) -
-                    log(transition(codon, (i) % 3, pro2.col(j - 1), p));
-            }
+    // backtracking to obtain alignment
+    return backtracking_profile(B, seqs1, seqs2, aln);
+}
 
-            // D(i,j) = highest weight between insertion, deletion, and
-            // match/mismatch
-            //	in this case, lowest (-log(weight)) value
-            if(d < P(i, j)) {
-                if(d < Q(i, j)) {
-                    D(i, j) = d;
-                    Bd(i, j) = 0;
-                } else {
-                    D(i, j) = Q(i, j);
-                    Bd(i, j) = 2;
-                }
-            } else {
-                if(P(i, j) < Q(i, j)) {
-                    D(i, j) = P(i, j);
-                    Bd(i, j) = 1;
-                } else {
-                    D(i, j) = Q(i, j);
-                    Bd(i, j) = 2;
-                }
-            }
-        }
+/* Weight of the alignment of profile matrices without backtracking. Only two
+ * rows (and the first column) of the DP matrices are kept. */
+int gotoh_profile_marginal_score_only(vector<string> seqs1,
+                                      vector<string> seqs2, alignment_t& aln,
+                                      Matrix64f& P_m,
+                                      const indel_params_t& indel) {
+    // P matrix for marginal Muse and Gaut codon model
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+    mg94_marginal_p(p, P_m);
+
+    Eigen::MatrixXd pro1 = create_profile(seqs1);
+    Eigen::MatrixXd pro2 = create_profile(seqs2);
+
+    int m = pro1.cols();
+    int n = pro2.cols();
+
+    if(check_codon_lengths(seqs1) != 0) {
+        return EXIT_FAILURE;
     }
 
+    // last 2 rows of DP matrices for match/mismatch (D), insertion (P), and
+    // deletion (Q), and of their backtracking info
+    float inf = std::numeric_limits<float>::max();
+    rolling_matrix_t<float> D(m + 1, n + 1, 2, 1, inf);
+    rolling_matrix_t<float> P(m + 1, n + 1, 2, 1, inf);
+    rolling_matrix_t<float> Q(m + 1, n + 1, 2, 1, inf);
+    rolling_matrix_t<int> Bd(m + 1, n + 1, 2, 1, -1);
+    rolling_matrix_t<int> Bp(m + 1, n + 1, 2, 1, -1);
+    rolling_matrix_t<int> Bq(m + 1, n + 1, 2, 1, -1);
+
+    gotoh_profile_fill(pro1, pro2, p, indel, D, P, Q, Bd, Bp, Bq);
+
     aln.weight += D(m, n);  // weight
 
-    // backtracking to obtain alignment
-    return backtracking_profile(Bd, Bp, Bq, seqs1, seqs2, aln);
+    return 0;
 }
 
 TEST_CASE("[profile_aln.cc] gotoh_profile_marginal") {
@@ -370,13 +378,45 @@ TEST_CASE("[profile_aln.cc] gotoh_profile_marginal") {
         REQUIRE(mg94_marginal({"CTCTGG", "CCTGG"}, aln_pair, P) == 0);
         CHECK(aln.f.seq_data == aln_pair.f.seq_data);
         CHECK(aln.weight == aln_pair.weight);
+        CHECK(gotoh_profile_marginal({"CTCTG"}, seqs2, aln, P) == EXIT_FAILURE);
+    }
+
+    SUBCASE("score only") {
+        seqs1 = {"CTCTGGATAGTG", "CTCTGGATAGTG"};
+        seqs2 = {"CTATAGTG", "CTAGAGTG"};
+
+        alignment_t aln_score;
+        REQUIRE(gotoh_profile_marginal(seqs1, seqs2, aln, P) == 0);
+        REQUIRE(gotoh_profile_marginal_score_only(seqs1, seqs2, aln_score, P) ==
+                0);
+        CHECK(aln_score.weight == aln.weight);
+        CHECK(aln_score.f.seq_data.empty());
+        CHECK(gotoh_profile_marginal_score_only({"CTCTGGATAGT"}, seqs2,
+                                                aln_score, P) == EXIT_FAILURE);
+    }
+
+    SUBCASE("threads") {  // more than one tile each way
+        string a, b;
+        for(int k = 0; k < 30; k++) {
+            a += "CTCTGGATAGTG";
+            b += k % 4 == 0 ? "CTATAGTG" : "CTCTGGATCGTGA";
+        }
+        string c = b;
+        c[100] = c[200] = 'A';
+        seqs1 = {a, a};
+        seqs2 = {b, c};
+
+        alignment_t aln_threads;
+        REQUIRE(gotoh_profile_marginal(seqs1, seqs2, aln, P) == 0);
+        REQUIRE(gotoh_profile_marginal(seqs1, seqs2, aln_threads, P, 3) == 0);
+        CHECK(aln_threads.f.seq_data == aln.f.seq_data);
+        CHECK(aln_threads.weight == aln.weight);
     }
 }
 
 /* Backtrack dynamic programming alignment of profile matrices and retrieve aln
  */
-int backtracking_profile(Eigen::MatrixXi Bd, Eigen::MatrixXi Bp,
-                         Eigen::MatrixXi Bq, vector<string> seqs1,
+int backtracking_profile(const traceback_t& B, vector<string> seqs1,
                          vector<string> seqs2, alignment_t& aln) {
     int i = seqs1[0].length();
     int j = seqs2[0].length();
@@ -387,7 +427,7 @@ int backtracking_profile(Eigen::MatrixXi Bd, Eigen::MatrixXi Bp,
     }
 
     while((i != 0) || (j != 0)) {
-        switch(Bd(i, j)) {
+        switch(B.bd(i, j)) {
         case 0:  // match/mismatch
             for(int s = 0; s < seqs1.size(); s++) {
                 aln_seqs[s].insert(0, 1, seqs1[s][i - 1]);
@@ -399,7 +439,7 @@ int backtracking_profile(Eigen::MatrixXi Bd, Eigen::MatrixXi Bp,
             j--;
             break;
         case 1:  // insertion
-            while(Bp(i, j) == 1) {
+            while(B.bp(i, j) == 1) {
                 for(int s = 0; s < seqs1.size(); s++) {
                     aln_seqs[s].insert(0, 1, '-');
                 }
@@ -417,7 +457,7 @@ int backtracking_profile(Eigen::MatrixXi Bd, Eigen::MatrixXi Bp,
             j--;
             break;
         case 2:  // deletion
-            while(Bq(i, j) == 1) {
+            while(B.bq(i, j) == 1) {
                 for(int s = 0; s < seqs1.size(); s++) {
                     aln_seqs[s].insert(0, 1, seqs1[s][i - 1]);
                 }
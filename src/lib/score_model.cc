@@ -0,0 +1,113 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#include <doctest/doctest.h>
+
+#include <coati/gotoh.hpp>
+#include <coati/score_model.hpp>
+
+score_model_t::score_model_t(const indel_params_t& indel)
+    : insertion{-log(indel.insertion)},
+      deletion{-log(indel.deletion)},
+      insertion_ext{-log(1.0 - (1.0 / indel.insertion_len))},
+      deletion_ext{-log(1.0 - (1.0 / indel.deletion_len))},
+      no_insertion{-log(1.0 - indel.insertion)},
+      no_deletion{-log(1.0 - indel.deletion)},
+      no_insertion_ext{-log(1.0 / indel.insertion_len)},
+      no_deletion_ext{-log(1.0 / indel.deletion_len)} {}
+
+score_model_t::score_model_t(const string& ref,
+                             const Eigen::Tensor<double, 3>& p,
+                             const indel_params_t& indel)
+    : score_model_t(indel) {
+    length_ = static_cast<int>(ref.length());
+    table_.assign(5 * (ref.length() + 1), 0.0);
+    const string nucs = "ACGTN";
+    for(int i = 1; i < length_ + 1; i++) {
+        string codon = ref.substr((((i - 1) / 3) * 3), 3);  // current codon
+        for(int b = 0; b < 5; b++) {
+            table_[5 * i + b] = -log(transition(codon, i % 3, nucs[b], p));
+        }
+    }
+}
+
+TEST_CASE("[score_model.cc] score_model_t") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+    Eigen::Tensor<double, 3> p(64, 3, 4);
+    mg94_marginal_p(p, P);
+
+    score_model_t model("CTCTGN", p);
+    CHECK(model.length() == 6);
+    for(char c : {'A', 'C', 'G', 'T', 'N'}) {
+        CHECK(model.emission(1, c) == -log(transition("CTC", 1, c, p)));
+        CHECK(model.emission(3, c) == -log(transition("CTC", 0, c, p)));
+        CHECK(model.emission(5, c) == -log(transition("TGN", 2, c, p)));
+    }
+    CHECK(model.emission_row(4)[score_model_t::nuc('G')] ==
+          model.emission(4, 'G'));
+
+    // ambiguous reference codons average over their compatible codons
+    double tga = 0.0;
+    for(string codon : {"TGA", "TGC", "TGG", "TGT"}) {
+        tga += transition(codon, 2, 'A', p) / 4.0;
+    }
+    CHECK(model.emission(5, 'A') == doctest::Approx(-log(tga)));
+    score_model_t ambiguous("NNNRCG", p);
+    double any = 0.0;
+    for(int cod = 0; cod < 64; cod++) {
+        any += p(cod, 0, 1) / 64.0;
+    }
+    CHECK(ambiguous.emission(1, 'C') == doctest::Approx(-log(any)));
+    for(int i = 1; i < 7; i++) {
+        for(char c : {'A', 'C', 'G', 'T', 'N'}) {
+            CHECK(std::isfinite(ambiguous.emission(i, c)));
+        }
+    }
+    // RCG is read as NCG
+    CHECK(ambiguous.emission(4, 'T') ==
+          doctest::Approx(score_model_t("NNNNCG", p).emission(4, 'T')));
+    // lower case and ambiguous nucleotides
+    CHECK(score_model_t::nuc('t') == 3);
+    CHECK(score_model_t::nuc('n') == 4);
+    CHECK(score_model_t::nuc('R') == 4);
+
+    CHECK(model.insertion == -log(0.001));
+    CHECK(model.no_deletion_ext == -log(1.0 / 6.0));
+    CHECK(model.nuc_freq('C') == -log(0.185));
+    CHECK(model.nuc_freq('N') == -log(0.25));
+
+    // defaults are the costs of the original model
+    CHECK(model.insertion_ext == -log(1.0 - (1.0 / 6.0)));
+    CHECK(model.no_insertion == -log(1.0 - 0.001));
+
+    indel_params_t indel;
+    indel.deletion = 0.01;
+    indel.insertion_len = 3.0;
+    score_model_t gaps(indel);
+    CHECK(gaps.insertion == model.insertion);
+    CHECK(gaps.deletion == doctest::Approx(-log(0.01)));
+    CHECK(gaps.no_deletion == doctest::Approx(-log(0.99)));
+    CHECK(gaps.insertion_ext == doctest::Approx(-log(2.0 / 3.0)));
+    CHECK(gaps.no_insertion_ext == doctest::Approx(-log(1.0 / 3.0)));
+    CHECK(gaps.deletion_ext == model.deletion_ext);
+}
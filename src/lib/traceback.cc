@@ -0,0 +1,171 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#include <doctest/doctest.h>
+
+#include <coati/traceback.hpp>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <boost/filesystem.hpp>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Allocate cache line aligned rows with all cells unset */
+traceback_t::traceback_t(int rows, int cols)
+    : rows_{rows}, cols_{cols}, stride_{stride(cols)}, window_rows_{rows} {
+    size_t size = std::max(bytes(), cache_line);
+    data_.reset(static_cast<uint8_t*>(std::aligned_alloc(cache_line, size)));
+    if(!data_) {
+        throw std::bad_alloc();
+    }
+    std::memset(data_.get(), 0xFF, size);
+    base_ = data_.get();
+    row1_ = filled_ = rows;
+}
+
+/* Store rows in a scratch file created in scratch_dir, mapping at most
+ * window_bytes (and at least one row) in memory at a time */
+traceback_t::traceback_t(int rows, int cols, const std::string& scratch_dir,
+                         size_t window_bytes)
+    : rows_{rows}, cols_{cols}, stride_{stride(cols)} {
+    window_rows_ = static_cast<int>(
+        std::min(std::max(window_bytes / stride_, size_t{1}),
+                 static_cast<size_t>(rows)));
+
+    std::string path = scratch_dir + "/coati-traceback-XXXXXX";
+    fd_ = mkstemp(&path[0]);
+    if(fd_ == -1) {
+        throw std::runtime_error("Creating scratch file in '" + scratch_dir +
+                                 "' failed: " + std::strerror(errno));
+    }
+    unlink(path.c_str());  // removed as soon as it is closed
+    if(ftruncate(fd_, static_cast<off_t>(std::max(bytes(), cache_line))) !=
+       0) {
+        int err = errno;
+        close(fd_);
+        throw std::runtime_error("Resizing scratch file in '" + scratch_dir +
+                                 "' failed: " + std::strerror(err));
+    }
+}
+
+traceback_t::~traceback_t() {
+    if(map_ != nullptr) munmap(map_, map_len_);
+    if(fd_ != -1) close(fd_);
+}
+
+/* Map the window of rows containing row i. Moving forward the window starts
+ * at row i, moving backward it ends at row i. Rows mapped for the first time
+ * are set to unset. */
+void traceback_t::map_rows(int i) const {
+    if(map_ != nullptr) {
+        munmap(map_, map_len_);
+        map_ = nullptr;
+    }
+    row0_ = i >= row1_ ? i : std::max(0, i - window_rows_ + 1);
+    row1_ = std::min(rows_, row0_ + window_rows_);
+
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    size_t offset = static_cast<size_t>(row0_) * stride_;
+    size_t delta = offset % page;
+    map_len_ = static_cast<size_t>(row1_ - row0_) * stride_ + delta;
+    void* ptr = mmap(nullptr, map_len_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd_, static_cast<off_t>(offset - delta));
+    if(ptr == MAP_FAILED) {
+        throw std::runtime_error(std::string("Mapping scratch file failed: ") +
+                                 std::strerror(errno));
+    }
+    map_ = static_cast<uint8_t*>(ptr);
+    base_ = map_ + delta;
+
+    if(row1_ > filled_) {
+        int first = std::max(filled_, row0_);
+        std::memset(base_ + (first - row0_) * stride_, 0xFF,
+                    static_cast<size_t>(row1_ - first) * stride_);
+        filled_ = row1_;
+    }
+}
+
+TEST_CASE("[traceback.cc] traceback_t") {
+    traceback_t tb(4, 70);
+    auto Bd = tb.d();
+    auto Bp = tb.p();
+    auto Bq = tb.q();
+
+    // unset cells
+    CHECK(tb.bd(3, 69) == -1);
+    CHECK(Bq(0, 0) == -1);
+
+    Bd(1, 2) = 0;
+    Bp(1, 2) = 2;
+    Bq(1, 2) = 1;
+    CHECK(tb.bd(1, 2) == 0);
+    CHECK(tb.bp(1, 2) == 2);
+    CHECK(tb.bq(1, 2) == 1);
+
+    Bd(3, 0) = Bp(0, 3) = Bq(3, 0) = 2;
+    CHECK(Bd(3, 0) == 2);
+    CHECK(Bp(0, 3) == 2);
+    CHECK(Bq(3, 0) == 2);
+    CHECK(Bd(0, 3) == -1);
+
+    Bd(1, 2) = -1;
+    CHECK(tb.bd(1, 2) == -1);
+    CHECK(tb.bp(1, 2) == 2);
+
+    // rows padded to cache lines
+    CHECK(tb.bytes() == 4 * 128);
+    CHECK(reinterpret_cast<uintptr_t>(tb.row(1)) % traceback_t::cache_line ==
+          0);
+}
+
+TEST_CASE("[traceback.cc] traceback_t - scratch file") {
+    traceback_t tb(300, 100, boost::filesystem::temp_directory_path().string(),
+                   4096);
+    CHECK(tb.on_disk());
+    CHECK(tb.resident_bytes() == 32 * 128);
+    CHECK(tb.bytes() == 300 * 128);
+
+    // write rows forward and read them back in reverse
+    for(int i = 0; i < 300; i++) {
+        uint8_t* row = tb.row(i);
+        for(int j = 0; j < 99; j++) {
+            row[j] = traceback_t::pack(i % 3, j % 3, (i + j) % 3);
+        }
+    }
+    bool same = true;
+    for(int i = 299; i >= 0; i--) {
+        for(int j = 0; j < 99; j++) {
+            same = same && tb.bd(i, j) == i % 3 && tb.bp(i, j) == j % 3 &&
+                   tb.bq(i, j) == (i + j) % 3;
+        }
+        same = same && tb.bd(i, 99) == -1;
+    }
+    CHECK(same);
+
+    CHECK_THROWS_AS(traceback_t(10, 10, "/nonexistent-coati-dir", 4096),
+                    std::runtime_error);
+}
@@ -357,6 +357,40 @@ int cod_int(string codon) {
            ((uint8_t)nt4_table[codon[1]] << 2) + ((uint8_t)nt4_table[codon[2]]);
 }
 
+/* Positions in codon list (see cod_int) of the codons compatible with codon,
+ * where ambiguous nucleotides (N or anything other than ACGT) stand for any
+ * nucleotide */
+vector<int> compatible_codons(const string& codon) {
+    vector<int> codons{0};
+    for(int k = 0; k < 3; k++) {
+        uint8_t base = nt4_table[static_cast<uint8_t>(codon[k])];
+        vector<int> next;
+        for(int cod : codons) {
+            for(int b = 0; b < 4; b++) {
+                if(base > 3 || base == b) next.push_back((cod << 2) + b);
+            }
+        }
+        codons.swap(next);
+    }
+    return codons;
+}
+
+TEST_CASE("[utils.cc] compatible_codons") {
+    CHECK(compatible_codons("CTG") == vector<int>{cod_int("CTG")});
+    CHECK(compatible_codons("ctg") == vector<int>{cod_int("CTG")});
+    CHECK(compatible_codons("TGN") ==
+          vector<int>{cod_int("TGA"), cod_int("TGC"), cod_int("TGG"),
+                      cod_int("TGT")});
+    CHECK(compatible_codons("RAA") ==
+          vector<int>{cod_int("AAA"), cod_int("CAA"), cod_int("GAA"),
+                      cod_int("TAA")});
+    vector<int> all = compatible_codons("NNN");
+    REQUIRE(all.size() == 64);
+    for(int cod = 0; cod < 64; cod++) {
+        CHECK(all[cod] == cod);
+    }
+}
+
 /* Read substitution rate matrix from a CSV file */
 int parse_matrix_csv(string file, Matrix64f& P, double& br_len) {
     ifstream input(file);
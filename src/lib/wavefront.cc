@@ -0,0 +1,202 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <coati/wavefront.hpp>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+void wavefront(int tile_rows, int tile_cols, int threads,
+               const std::function<void(int, int)>& fill) {
+    if(threads <= 1) {
+        for(int r = 0; r < tile_rows; r++) {
+            for(int c = 0; c < tile_cols; c++) {
+                fill(r, c);
+            }
+        }
+        return;
+    }
+
+    // unfinished dependencies of each tile (tiles above and to the left)
+    std::vector<int> pending(static_cast<size_t>(tile_rows) * tile_cols);
+    for(int r = 0; r < tile_rows; r++) {
+        for(int c = 0; c < tile_cols; c++) {
+            pending[static_cast<size_t>(r) * tile_cols + c] =
+                (r > 0 ? 1 : 0) + (c > 0 ? 1 : 0);
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable ready_cv;
+    std::deque<std::pair<int, int>> ready{{0, 0}};
+    int remaining = tile_rows * tile_cols;
+    std::exception_ptr error;
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;) {
+            ready_cv.wait(lock, [&]() {
+                return !ready.empty() || remaining == 0 || error;
+            });
+            if(remaining == 0 || error) {
+                return;
+            }
+            auto [r, c] = ready.front();
+            ready.pop_front();
+
+            lock.unlock();
+            try {
+                fill(r, c);
+            } catch(...) {
+                lock.lock();
+                if(!error) {
+                    error = std::current_exception();
+                }
+                ready_cv.notify_all();
+                return;
+            }
+            lock.lock();
+
+            // release the tiles below and to the right
+            remaining--;
+            if(r + 1 < tile_rows &&
+               --pending[static_cast<size_t>(r + 1) * tile_cols + c] == 0) {
+                ready.emplace_back(r + 1, c);
+            }
+            if(c + 1 < tile_cols &&
+               --pending[static_cast<size_t>(r) * tile_cols + c + 1] == 0) {
+                ready.emplace_back(r, c + 1);
+            }
+            ready_cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    int workers = std::min(threads, std::min(tile_rows, tile_cols));
+    for(int t = 0; t < workers; t++) {
+        pool.emplace_back(worker);
+    }
+    for(auto& thread : pool) {
+        thread.join();
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void parallel_tasks(int tasks, int threads,
+                    const std::function<void(int)>& run) {
+    if(threads <= 1 || tasks <= 1) {
+        for(int t = 0; t < tasks; t++) {
+            run(t);
+        }
+        return;
+    }
+
+    std::atomic<int> next{0};
+    std::mutex mutex;
+    std::exception_ptr error;
+
+    auto worker = [&]() {
+        for(int t = next++; t < tasks; t = next++) {
+            try {
+                run(t);
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!error) {
+                    error = std::current_exception();
+                }
+                next = tasks;  // no new tasks
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for(int t = 0; t < std::min(threads, tasks); t++) {
+        pool.emplace_back(worker);
+    }
+    for(auto& thread : pool) {
+        thread.join();
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+TEST_CASE("[wavefront.cc] wavefront") {
+    SUBCASE("dependencies") {
+        for(int threads : {1, 4}) {
+            int rows = 5, cols = 7;
+            std::vector<std::atomic<int>> done(rows * cols);
+            std::atomic<bool> ordered{true};
+
+            wavefront(rows, cols, threads, [&](int r, int c) {
+                if((r > 0 && !done[(r - 1) * cols + c]) ||
+                   (c > 0 && !done[r * cols + c - 1])) {
+                    ordered = false;
+                }
+                done[r * cols + c] = 1;
+            });
+
+            CHECK(ordered);
+            for(auto& d : done) {
+                CHECK(d == 1);
+            }
+        }
+    }
+    SUBCASE("exception") {
+        CHECK_THROWS_AS(wavefront(3, 3, 2,
+                                  [](int r, int c) {
+                                      if(r == 1 && c == 1) {
+                                          throw std::runtime_error("tile");
+                                      }
+                                  }),
+                        std::runtime_error);
+    }
+}
+
+TEST_CASE("[wavefront.cc] parallel_tasks") {
+    for(int threads : {1, 3}) {
+        std::vector<std::atomic<int>> done(10);
+        parallel_tasks(10, threads, [&](int t) { done[t]++; });
+        for(auto& d : done) {
+            CHECK(d == 1);
+        }
+        CHECK_THROWS_AS(parallel_tasks(10, threads,
+                                       [](int t) {
+                                           if(t == 4) {
+                                               throw std::runtime_error("task");
+                                           }
+                                       }),
+                        std::runtime_error);
+    }
+}
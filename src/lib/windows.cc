@@ -0,0 +1,354 @@
+/*
+# Copyright (c) 2021 Juan J. Garcia Mesa <juanjosegarciamesa@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+*/
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <coati/align.hpp>
+#include <coati/windows.hpp>
+#include <unordered_map>
+
+namespace {
+// overlap of consecutive windows, a fifth of the window in whole codons
+int window_overlap(int window) { return max(3, window / 15 * 3); }
+
+/* Cells (i, j) of the DP matrix of seq_a and seq_b visited by aln, an
+ * alignment of seq_a[start.first, ...) and seq_b[start.second, ...): cell c
+ * is the one before column c and the last cell is after the last column */
+vector<pair<int, int>> alignment_path(const alignment_t& aln,
+                                      pair<int, int> start) {
+    const string& a = aln.f.seq_data[0];
+    const string& b = aln.f.seq_data[1];
+    vector<pair<int, int>> path{start};
+    for(size_t c = 0; c < a.length(); c++) {
+        path.push_back({path.back().first + (a[c] != '-'),
+                        path.back().second + (b[c] != '-')});
+    }
+    return path;
+}
+
+/* Cells left[l] and right[r] at which the alignment of a window (path left,
+ * from cell left[first] on) hands over to the next one (path right), with
+ * lo < i < hi for the rows i of their overlap. The seam is the middle of the
+ * longest run of cells, two or more, that both paths visit, so the columns on
+ * either side of it belong to both alignments. If there is none, right[r] is
+ * the first cell of right at or after the middle codon of the overlap that is
+ * followed by a match and left[l] the last cell of left before it in both
+ * sequences that follows a match; the nucleotides in between are aligned as an
+ * insertion and a deletion. */
+pair<int, int> seam(const vector<pair<int, int>>& left,
+                    const vector<pair<int, int>>& right, int first, int lo,
+                    int hi) {
+    auto key = [](pair<int, int> x) {
+        return (static_cast<uint64_t>(x.first) << 32) |
+               static_cast<uint32_t>(x.second);
+    };
+    unordered_map<uint64_t, int> index;
+    for(int r = 0; r < static_cast<int>(right.size()); r++) {
+        if(right[r].first > lo && right[r].first < hi) {
+            index.emplace(key(right[r]), r);
+        }
+    }
+
+    // longest run of consecutive cells of left that right also visits
+    int best_start = -1, best_len = 1, start = -1;
+    for(int l = first + 1; l < static_cast<int>(left.size()); l++) {
+        bool shared = left[l].first > lo && left[l].first < hi &&
+                      index.count(key(left[l])) > 0;
+        if(!shared) {
+            start = -1;
+            continue;
+        }
+        if(start < 0) start = l;
+        if(l - start + 1 > best_len) {
+            best_start = start;
+            best_len = l - start + 1;
+        }
+    }
+    if(best_start >= 0) {
+        int l = best_start + best_len / 2;
+        return {l, index[key(left[l])]};
+    }
+
+    auto match = [](pair<int, int> x, pair<int, int> y) {
+        return y.first == x.first + 1 && y.second == x.second + 1;
+    };
+    const int mid = (lo + hi) / 6 * 3;
+    const int last = static_cast<int>(right.size()) - 1;
+    int r = 0;
+    for(; r < last; r++) {
+        if(right[r].first >= mid && right[r].first >= left[first].first &&
+           right[r].second >= left[first].second &&
+           match(right[r], right[r + 1])) {
+            break;
+        }
+    }
+    int l = static_cast<int>(left.size()) - 1;
+    for(; l > first; l--) {
+        if(left[l].first <= right[r].first &&
+           left[l].second <= right[r].second && match(left[l - 1], left[l])) {
+            break;
+        }
+    }
+    return {l, r};
+}
+}  // namespace
+
+/* Windows of window reference nucleotides (a multiple of 3) that overlap by
+ * overlap nucleotides and cover the reference. The query region of a window is
+ * its projection by the length ratio of the sequences, widened by overlap on
+ * each side; the first window starts and the last one ends at the corners of
+ * the DP matrix. Windows advance by at least 3 nucleotides even if overlap is
+ * not smaller than window. */
+vector<window_t> split_windows(int m, int n, int window, int overlap) {
+    vector<window_t> windows;
+    double scale = m > 0 ? static_cast<double>(n) / m : 0.0;
+    const int step = max(window - overlap, 3);
+    for(int a0 = 0;; a0 += step) {
+        int a1 = min(a0 + window, m);
+        int b0 = max(0, static_cast<int>(std::floor(a0 * scale)) - overlap);
+        int b1 = min(n, static_cast<int>(std::ceil(a1 * scale)) + overlap);
+        windows.push_back({a0, a1, b0, b1});
+        if(a1 == m) break;
+    }
+    windows.back().b1 = n;
+    return windows;
+}
+
+/* Estimated memory of mg94_marginal_windowed: the backtracking info of the
+ * largest window, once per thread */
+size_t windowed_bytes(int m, int n, int window, int threads) {
+    vector<window_t> windows =
+        split_windows(m, n, window, window_overlap(window));
+    size_t bytes = 0;
+    for(const auto& w : windows) {
+        bytes = max(bytes,
+                    (w.a1 - w.a0 + 1) * traceback_t::stride(w.b1 - w.b0 + 1));
+    }
+    return bytes * min<size_t>(max(threads, 1), windows.size());
+}
+
+/* Marginal MG94 alignment in overlapping windows of the reference (see
+ * split_windows), each aligned against its query region with mg94_marginal
+ * as independent problems on up to threads threads. Consecutive windows are
+ * stitched at a cell of their overlap that both alignments visit (see seam),
+ * so memory depends on the window size and not on the sequence lengths. The
+ * weight is that of the whole stitched alignment. */
+int mg94_marginal_windowed(vector<string> sequences, alignment_t& aln,
+                           Matrix64f& P_m, int window, int threads,
+                           const indel_params_t& indel) {
+    const string& seq_a = sequences[0];
+    const string& seq_b = sequences[1];
+    int m = seq_a.length();
+    int n = seq_b.length();
+
+    if(check_codon_lengths(sequences) != 0) {
+        return EXIT_FAILURE;
+    }
+    if(window < 15 || window % 3 != 0) {
+        cerr << "Window length must be a multiple of 3 of at least 15 ("
+             << window << "). Exiting!" << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<window_t> windows =
+        split_windows(m, n, window, window_overlap(window));
+    vector<alignment_t> parts(windows.size());
+    vector<vector<pair<int, int>>> paths(windows.size());
+    vector<int> status(windows.size(), 0);
+    parallel_tasks(windows.size(), threads, [&](int w) {
+        const window_t& x = windows[w];
+        string sub_a = seq_a.substr(x.a0, x.a1 - x.a0);
+        string sub_b = seq_b.substr(x.b0, x.b1 - x.b0);
+        if(sub_a.empty() || sub_b.empty()) {
+            // only insertions or deletions
+            parts[w].f.seq_data = {sub_a + string(sub_b.length(), '-'),
+                                   string(sub_a.length(), '-') + sub_b};
+        } else {
+            status[w] = mg94_marginal({sub_a, sub_b}, parts[w], P_m, indel);
+        }
+        paths[w] = alignment_path(parts[w], {x.a0, x.b0});
+    });
+    for(int s : status) {
+        if(s != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    aln.f.seq_data = {string(), string()};
+    int from = 0;  // first cell of the current window in the alignment
+    for(size_t w = 0; w < windows.size(); w++) {
+        const vector<pair<int, int>>& path = paths[w];
+        int to = static_cast<int>(path.size()) - 1, next = 0;
+        if(w + 1 < windows.size()) {
+            tie(to, next) = seam(path, paths[w + 1], from, windows[w + 1].a0,
+                                 windows[w].a1);
+        }
+        string& a = aln.f.seq_data[0];
+        string& b = aln.f.seq_data[1];
+        a += parts[w].f.seq_data[0].substr(from, to - from);
+        b += parts[w].f.seq_data[1].substr(from, to - from);
+        if(w + 1 < windows.size()) {
+            // nucleotides between the cells of a seam that no alignment
+            // shares. Insertions go before any deletion at the end, as an
+            // insertion cannot follow a deletion.
+            pair<int, int> x = path[to], y = paths[w + 1][next];
+            int del = y.first - x.first, ins = y.second - x.second;
+            size_t k = b.length();
+            while(k > 0 && b[k - 1] == '-') k--;
+            a.insert(k, string(ins, '-'));
+            b.insert(k, seq_b.substr(x.second, ins));
+            a += seq_a.substr(x.first, del);
+            b += string(del, '-');
+        }
+        from = next;
+    }
+    aln.weight = alignment_score(aln.f.seq_data, P_m, indel);
+
+    return 0;
+}
+
+TEST_CASE("[windows.cc] split_windows") {
+    vector<window_t> windows = split_windows(3000, 2700, 900, 180);
+    REQUIRE(windows.size() == 4);
+    CHECK(windows[0].a0 == 0);
+    CHECK(windows[0].b0 == 0);
+    CHECK(windows.back().a1 == 3000);
+    CHECK(windows.back().b1 == 2700);
+    for(size_t w = 0; w < windows.size(); w++) {
+        CHECK(windows[w].a0 % 3 == 0);
+        CHECK(windows[w].a1 - windows[w].a0 <= 900);
+        CHECK(windows[w].b0 < windows[w].b1);
+        if(w > 0) {
+            // consecutive windows overlap in both sequences
+            CHECK(windows[w].a0 == windows[w - 1].a1 - 180);
+            CHECK(windows[w].b0 < windows[w - 1].b1);
+        }
+    }
+    CHECK(windows[1].a0 == 720);
+    CHECK(windows[1].b0 == 648 - 180);
+
+    // a single window covers short sequences
+    windows = split_windows(300, 360, 900, 180);
+    REQUIRE(windows.size() == 1);
+    CHECK(windows[0].a1 == 300);
+    CHECK(windows[0].b1 == 360);
+
+    // windows not longer than their overlap still advance
+    windows = split_windows(30, 30, 3, window_overlap(3));
+    REQUIRE(windows.size() == 10);
+    CHECK(windows[1].a0 == 3);
+    CHECK(windows.back().a1 == 30);
+}
+
+TEST_CASE("[windows.cc] seam") {
+    // diagonal paths from (a0, b0) of length cells
+    auto diagonal = [](int a0, int b0, int length) {
+        vector<pair<int, int>> path;
+        for(int c = 0; c < length; c++) {
+            path.push_back({a0 + c, b0 + c});
+        }
+        return path;
+    };
+    vector<pair<int, int>> left = diagonal(0, 0, 31);
+
+    // middle of the cells both paths visit in the overlap
+    CHECK(seam(left, diagonal(15, 15, 31), 0, 15, 30) ==
+          pair<int, int>{23, 8});
+
+    // no shared cells: hand over at the middle codon of the overlap
+    vector<pair<int, int>> right = diagonal(15, 20, 16);
+    pair<int, int> s = seam(left, right, 0, 15, 30);
+    CHECK(s == pair<int, int>{21, 6});
+    CHECK(left[s.first] == pair<int, int>{21, 21});
+    CHECK(right[s.second] == pair<int, int>{21, 26});
+}
+
+TEST_CASE("[windows.cc] mg94_marginal_windowed") {
+    Matrix64f P;
+    mg94_p(P, 0.0133);
+
+    for(string name : {"001", "002", "003"}) {
+        fasta_t f("../../fasta/example-" + name + ".fasta");
+        REQUIRE(read_fasta(f) == 0);
+        alignment_t aln, aln_windowed;
+        REQUIRE(mg94_marginal(f.seq_data, aln, P) == 0);
+
+        // one window is the full alignment
+        REQUIRE(mg94_marginal_windowed(f.seq_data, aln_windowed, P) == 0);
+        CHECK(aln_windowed.f.seq_data == aln.f.seq_data);
+        CHECK(aln_windowed.weight == doctest::Approx(aln.weight));
+    }
+
+    SUBCASE("unrelated pair") {
+        // windows do not share cells in their overlaps and are stitched with
+        // an insertion and a deletion at each seam
+        fasta_t f("../../fasta/example-003.fasta");
+        REQUIRE(read_fasta(f) == 0);
+        string ref = f.seq_data[0];
+        string query(ref.rbegin(), ref.rend());
+        alignment_t aln;
+        REQUIRE(mg94_marginal_windowed({ref, query}, aln, P, 60) == 0);
+        string a = aln.f.seq_data[0];
+        string b = aln.f.seq_data[1];
+        REQUIRE(a.length() == b.length());
+        for(size_t c = 1; c < a.length(); c++) {
+            // an insertion never follows a deletion
+            CHECK_FALSE((b[c - 1] == '-' && a[c] == '-'));
+        }
+        a.erase(std::remove(a.begin(), a.end(), '-'), a.end());
+        b.erase(std::remove(b.begin(), b.end(), '-'), b.end());
+        CHECK(a == ref);
+        CHECK(b == query);
+        CHECK(aln.weight ==
+              doctest::Approx(alignment_score(aln.f.seq_data, P)));
+
+        alignment_t aln_threads;
+        REQUIRE(mg94_marginal_windowed({ref, query}, aln_threads, P, 60, 2) ==
+                0);
+        CHECK(aln_threads.f.seq_data == aln.f.seq_data);
+        CHECK(aln_threads.weight == aln.weight);
+    }
+    SUBCASE("related pair") {
+        // windows agree in their overlaps and stitch into the full alignment
+        fasta_t f("../../fasta/example-003.fasta");
+        REQUIRE(read_fasta(f) == 0);
+        string ref = f.seq_data[0];
+        string query = ref.substr(0, 120) + ref.substr(126, 150) + "ACGTAC" +
+                       ref.substr(276);
+        query[30] = 'A';
+        query[200] = 'C';
+        alignment_t aln, aln_windowed;
+        REQUIRE(mg94_marginal({ref, query}, aln, P) == 0);
+        REQUIRE(mg94_marginal_windowed({ref, query}, aln_windowed, P, 120) ==
+                0);
+        CHECK(aln_windowed.f.seq_data == aln.f.seq_data);
+        CHECK(aln_windowed.weight == doctest::Approx(aln.weight));
+    }
+    SUBCASE("invalid input") {
+        alignment_t aln;
+        CHECK(mg94_marginal_windowed({"CTCTGGATAGT", "CTATAGTG"}, aln, P) ==
+              EXIT_FAILURE);
+        CHECK(mg94_marginal_windowed({"CTCTGGATAGTG", "CTATAGTG"}, aln, P,
+                                     100) == EXIT_FAILURE);
+    }
+}